@@ -1,6 +1,7 @@
 @echo off
 set platform=%1
 set varspath=%2
+set defines=%~3
 
 echo starting windows %platform% build
 
@@ -11,7 +12,7 @@ mkdir .\obj\win\%platform%
 echo setting build variables
 call %varspath%
 
-cl /TC /GL /WX /W3 /DEBUG /Zi /D "_CRT_SECURE_NO_WARNINGS"^
+cl /TC /GL /WX /W3 /DEBUG /Zi /D "_CRT_SECURE_NO_WARNINGS" %defines%^
   .\src\fc85.c^
   /Fo:".\obj\win\%platform%\fc85.obj"^
   /Fe:".\bin\win\%platform%\fc85.exe"^
@@ -20,6 +21,15 @@ cl /TC /GL /WX /W3 /DEBUG /Zi /D "_CRT_SECURE_NO_WARNINGS"^
   /link ".\lib\sdl2\lib\win\%platform%\SDL2.lib"^
   ".\lib\lua\lib\%platform%\lua53.lib"
 
+cl /TC /GL /WX /W3 /DEBUG /Zi /D "_CRT_SECURE_NO_WARNINGS" %defines%^
+  .\src\fc85_batch.c^
+  /Fo:".\obj\win\%platform%\fc85_batch.obj"^
+  /Fe:".\bin\win\%platform%\fc85_batch.exe"^
+  /I ".\lib\sdl2\include"^
+  /I ".\lib\lua\include"^
+  /link ".\lib\sdl2\lib\win\%platform%\SDL2.lib"^
+  ".\lib\lua\lib\%platform%\lua53.lib"
+
 
 REM cl /TC /GL /WX /W3 /O2 /Os /D "_CRT_SECURE_NO_WARNINGS"^
 REM   .\src\fc85.c^
@@ -1,2 +1,2 @@
 @echo off
-call .\bld\build_win.base.bat x64 "C:\Program Files (x86)\Microsoft Visual Studio 14.0\VC\bin\amd64\vcvars64.bat"
+call .\bld\build_win.base.bat x64 "C:\Program Files (x86)\Microsoft Visual Studio 14.0\VC\bin\amd64\vcvars64.bat" %1
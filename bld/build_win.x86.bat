@@ -1,2 +1,2 @@
 @echo off
-call .\bld\build_win.base.bat x86 "C:\Program Files (x86)\Microsoft Visual Studio 14.0\VC\bin\vcvars32.bat"
+call .\bld\build_win.base.bat x86 "C:\Program Files (x86)\Microsoft Visual Studio 14.0\VC\bin\vcvars32.bat" %1
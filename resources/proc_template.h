@@ -38,7 +38,7 @@ static void gamesProcess_Tick(GamesProcess *self, System *sys)
 static void gamesProcess_Execute(System *sys)
 {
   GamesProcess *sysProc = gamesProcess_Create();
-  system_PushProc(sys, sysProc, gamesProcess_Tick, gamesProcess_Destroy);
+  system_PushProc(sys, PROC_TYPE_NONE, sysProc, gamesProcess_Tick, NULL, gamesProcess_Destroy);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -6,11 +6,26 @@
 // Includes
 /* ------------------------------------------------------------------------- */
 
+#ifdef _WIN32
+#define _CRT_RAND_S // rand_s, for the disk cache key
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
+#include <time.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #define SDL_MAIN_HANDLED
 #include <SDL.h>
 #include <lua.h>
@@ -24,6 +39,23 @@
 #define SYS_MEMORY              65536
 #define SYS_FLAG_SHUTDOWN       0x80
 #define SYS_NUM_PROCESSES       8
+#define SYS_SNAPSHOT_FILE_NAME  "fc85.hib"
+#define SYS_STATE_FILE_NAME     "fc85.state"
+#define SYS_REWIND_FRAMES       600 // 10 seconds at 60Hz
+#define SYS_REWIND_BUFFER_SIZE  (4 * 1024 * 1024)
+#define SYS_SNAPSHOT_MAGIC      0x35384346 // "FC85"
+
+#define PROC_TYPE_NONE          0
+#define PROC_TYPE_INPUT         1
+#define PROC_TYPE_SYS           2
+#define PROC_TYPE_GAMES         3
+#define PROC_TYPE_CREATE        4
+#define PROC_TYPE_EDIT          5
+#define PROC_TYPE_CODE          6
+#define PROC_TYPE_PLAY          7
+#define PROC_TYPE_COUNT         8
+#define PROC_ARENA_SLOTS        2 // instances per process type, see ProcessArena
+#define PROC_STATE_SIZE         128
 
 #define DISP_WIDTH_PIXELS       96
 #define DISP_HEIGHT_PIXELS      64
@@ -51,7 +83,30 @@
 #define INPT_BTN_A              0x0002
 #define INPT_BTN_B              0x0001
 
+#define INPT_EVENT_RING_SIZE    32 // power of two, at most 128
+#define INPT_EVENT_PRESS        0x01
+#define INPT_EVENT_RELEASE      0x02
+#define INPT_EVENT_REPEAT       0x04
+#define INPT_SCRIPT_TEXT_SIZE   16
+#define INPT_HOST_SAVE_STATE    0x01
+#define INPT_HOST_LOAD_STATE    0x02
+#define INPT_HOST_SAVE_FILE     0x04
+#define INPT_HOST_LOAD_FILE     0x08
+#define INPT_HEADLESS_DELTA     (1.0f / 60.0f)
+#define INPT_RECORD_MAGIC       0x52384346
+#define INPT_RECORD_BTNS        0x01
+#define INPT_RECORD_TEXT        0x02
+#define INPT_RECORD_DELTA       0x04
+#define INPT_RECORD_CLOCK       0x08
+#define INPT_RECORD_EVENTS      0x10
+#define INPT_RECORD_RUN         0x80 // low bits count repeats of the last frame
+#define INPT_RECORD_MAX_RUN     0x7F
+
 #define HOME_INPUT_BUFFER_SIZE  256
+#define HOME_INPUT_NONE         0
+#define HOME_INPUT_PENDING      1
+#define HOME_INPUT_ACCEPTED     2
+#define HOME_INPUT_CANCELLED    3
 
 #define DISK_FILE_NAME          "fc85.disk"
 #define DISK_SIZE               163840
@@ -60,10 +115,30 @@
 #define DISK_FILE_SIZE_MAX      DISK_FILE_MAX_BLOCKS*DISK_BLOCK_SIZE
 #define DISK_FILE_NAME_SIZE     16
 #define DISK_FILE_MAX_BLOCKS    32
+#define DISK_MAX_MOUNTS         8
+#define DISK_MOUNT_PATH_SIZE    260
 #define DISK_CODE_NONE           0
 #define DISK_CODE_WRITE          1
 #define DISK_CODE_READ           2
 #define DISK_CODE_DIR            3
+#define DISK_CODE_PLAY           4
+#define DISK_CODE_PREFETCH       5
+#define DISK_CACHE_PREFIX        '~' // files the console keeps for itself, never listed
+#define DISK_CACHE_KEY_FILE      "fc85.key"
+#define DISK_CACHE_KEY_SIZE      16
+#define DISK_CACHE_TAG_SIZE      8 // appended to every cache file on disk
+#define DISK_CACHE_MAX_BLOCKS    (DISK_BLOCK_COUNT / 4)
+
+#define PROFILE_FILE_NAME       "fc85.prof"
+#define PROFILE_STAGE_FRAME     0
+#define PROFILE_STAGE_INPUT     1
+#define PROFILE_STAGE_SYSTEM    2
+#define PROFILE_STAGE_DISPLAY   3
+#define PROFILE_STAGE_DISK      4
+#define PROFILE_STAGE_PROC      5 // + process type
+#define PROFILE_STAGE_COUNT     (PROFILE_STAGE_PROC + PROC_TYPE_COUNT)
+#define PROFILE_BUCKETS         84 // 4 per power of two, up to ~2s
+#define PROFILE_WINDOW          256 // samples in the rolling histograms
 
 #define INTERRUPT_CODE_INVALID  0
 #define INTERRUPT_CODE_DISK     1
@@ -104,17 +179,33 @@ typedef struct {
 } Game;
 
 typedef struct {
+  byte type;
   void *data;
   void (*tick)(void *, void *);
   void (*restore)(void *, void *);
   void (*destroy)(void *);
 } Process;
 
+typedef struct {
+  byte type;
+  byte state[PROC_STATE_SIZE];
+} ProcessDescriptor;
+
+typedef struct {
+  const char *name;
+  void (*save)(void *, void *, byte *);
+  void (*resume)(void *, const byte *);
+  size_t offset;  // slab position in the process arena
+  size_t size;    // bytes per slot
+  byte capacity;  // slots in the slab, 0 for types that own no data
+} ProcessType;
+
 typedef struct {
   struct {
     struct _sys {
       byte flags;
       float delta;
+      dword clock; // wall clock seconds, latched by the host each frame
     } sys;
     struct _disp {
       byte flags;
@@ -132,16 +223,28 @@ typedef struct {
       byte cursorCol;
       byte cursorOn;
       float cursorTimer;
+      byte inputStatus;
       byte inputBuffer[HOME_INPUT_BUFFER_SIZE];
     } home;
     struct _disk {
       byte code;
+      dword size; // bytes to write, 0 writes up to the first NUL
       byte name[DISK_FILE_NAME_SIZE];
       byte buffer[DISK_FILE_SIZE_MAX];
     } disk;
     struct _inpt {
       word btns;
       byte text[16];
+      // single producer/consumer ring: only the input device advances head,
+      // only the system advances tail, each after its slots are done with
+      byte head;
+      byte tail;
+      byte dropped; // events lost to a full ring
+      struct _inptEvent {
+        dword time; // milliseconds on the host input clock
+        word btn;
+        byte flags;
+      } events[INPT_EVENT_RING_SIZE];
     } inpt;
     byte appl[SYS_MEMORY - (sizeof(struct _sys) + sizeof(struct _home) + sizeof(struct _disp) + sizeof(struct _disk) + sizeof(struct _inpt))];
   } mem;
@@ -149,12 +252,49 @@ typedef struct {
   Process procStack[SYS_NUM_PROCESSES];
   byte deadProcCount;
   Process deadProcStack[SYS_NUM_PROCESSES];
+  struct _procArena *procArena; // owned by the FC85, survives boot/resume
+#ifdef FC85_PROFILE
+  struct _profiler *prof;       // owned by the FC85, survives boot/resume
+#endif
 } System;
 
 typedef struct {
+  dword magic;
+  dword memSize;
+  dword layout; // system_Layout() of the build that took it
+  byte procCount;
+  ProcessDescriptor procs[SYS_NUM_PROCESSES];
+  byte mem[msizeof(System, mem)];
+} Snapshot;
+
+typedef struct {
+  word window[PROFILE_BUCKETS];   // samples per bucket in the rolling window
+  dword total[PROFILE_BUCKETS];   // samples per bucket since startup
+  byte recent[PROFILE_WINDOW];    // bucket of each sample in the window
+  word next;
+  word count;
+  dword samples;
+  dword max;
+  Uint64 start;
+} Histogram;
+
+typedef struct _profiler {
+  bool overlay;
+  Uint64 frequency;
+  Histogram stages[PROFILE_STAGE_COUNT];
+  Histogram compiled; // game launches that compiled the source
+  Histogram cached;   // game launches loaded from the cache
+  size_t heapPeak;    // most any game's Lua heap has held
+  dword heapFailures; // allocations games were refused
+} Profiler;
+
+typedef struct {
+  bool headless;
+  Uint64 presented; // performance counter when the last frame went out
   SDL_Window *window;
   SDL_Renderer *renderer;
   SDL_Texture *texture;
+  int pixels[DISP_WIDTH_PIXELS * DISP_HEIGHT_PIXELS];
 } DisplayDevice;
 
 typedef union {
@@ -168,13 +308,72 @@ typedef union {
       byte blocks[DISK_FILE_MAX_BLOCKS];
       dword size;
       byte blockCount;
-      byte reserved[11];
+      byte reserved;
+      word plays;
+      dword modified; // time of the last write, 0 when unknown
+      dword played;   // time of the last play, 0 when never played
     } fileTable[((DISK_BLOCK_SIZE*2)/sizeof(struct _file))-1];
   } hdr;
+} DiskImage;
+
+typedef struct {
+  char fileName[DISK_MOUNT_PATH_SIZE];
+  DiskImage *image;
+  struct _header *hdr;
+  bool isOverlay;
+  bool isReadOnly;
+  byte *overlay[DISK_BLOCK_COUNT]; // copy-on-write blocks, overlay mode only
+} DiskMount;
+
+typedef struct {
+  byte mountCount;
+  DiskMount mounts[DISK_MAX_MOUNTS];
+  bool dirDirty;
+  word dirCount;
+  struct _dirEntry {
+    struct _file *file;
+    byte mount;
+    byte rank;
+  } dir[DISK_MAX_MOUNTS * (msizeof(struct _header, fileTable) / sizeof(struct _file))];
+  struct _staging {
+    bool valid;
+    byte name[DISK_FILE_NAME_SIZE];
+    dword size;
+    byte data[DISK_FILE_SIZE_MAX];
+  } staging;
+  bool cacheKeyed;
+  byte cacheKey[DISK_CACHE_KEY_SIZE];
 } DiskDevice;
 
 typedef struct {
-  byte pass;
+  dword frame;
+  word btns;
+  byte text[INPT_SCRIPT_TEXT_SIZE];
+} InputScriptEntry;
+
+typedef struct {
+  dword frame;
+  byte hostKeys;            // console keys for the host, never seen by the system
+  bool rewinding;           // rewind key held down
+  InputScriptEntry *script; // headless input, NULL when reading SDL events
+  dword scriptCount;
+  dword scriptNext;
+  FILE *record;             // session being recorded, NULL when not recording
+  byte recordRun;           // repeated frames not yet written
+  byte *replay;             // session being replayed, NULL when live
+  dword replaySize;
+  dword replayNext;
+  byte replayRun;
+  struct _inptFrame {       // previous frame, what the stream is relative to
+    word btns;
+    float delta;
+    dword clock;
+  } last;
+  byte frameHead;           // first ring slot pushed this frame
+  Uint64 arrivals[INPT_EVENT_RING_SIZE]; // performance counter per ring slot
+  Uint64 counterBase;       // performance counter and SDL ticks sampled
+  Uint64 ticksBase;         // together, to convert event timestamps
+  Histogram latency;        // input to present, microseconds
 } InputDevice;
 
 typedef struct {
@@ -182,6 +381,12 @@ typedef struct {
   DisplayDevice disp;
   DiskDevice disk;
   InputDevice inpt;
+#ifdef FC85_PROFILE
+  Profiler prof;
+#endif
+  struct _saveState *saveState; // in-memory save slot, NULL until first save
+  struct _rewind *rewind;       // recent frames, NULL unless enabled
+  Uint64 lastTicks;             // SDL ticks at the previous frame
 } FC85;
 
 /* ------------------------------------------------------------------------- */
@@ -189,14 +394,26 @@ typedef struct {
 /* ------------------------------------------------------------------------- */
 
 #include "font.h"
-static FC85 *_fc85 = NULL;
-static jmp_buf inputJmpBuf;
+
+// stage timers compile away entirely unless FC85_PROFILE is defined
+#ifdef FC85_PROFILE
+static void profiler_Begin(Profiler *self, byte stage);
+static void profiler_End(Profiler *self, byte stage);
+#define PROFILE_BEGIN(prof, stage)  profiler_Begin((prof), (stage))
+#define PROFILE_END(prof, stage)    profiler_End((prof), (stage))
+#else
+#define PROFILE_BEGIN(prof, stage)
+#define PROFILE_END(prof, stage)
+#endif
 static bool system_IsShutdownFlagSet(System *self);
-static void system_PushProc(System *self, void *data, void (*tick)(void *, void *), void (*restore)(void *, void *), void (*destroy)(void *));
+static void system_PushProc(System *self, byte type, void *data, void (*tick)(void *, void *), void (*restore)(void *, void *), void (*destroy)(void *));
 static void system_PopProc(System *self);
-static void tick();
+static void system_DestroyProcs(System *self);
 static void diskDevice_Interrupt(DiskDevice *self, System *sys);
-static FC85 *fc85_Get();
+
+// every system is embedded in a console, so the console that owns it is a
+// fixed offset away and no global is needed to find it
+#define fc85_FromSystem(sys) ((FC85 *)((byte *)(sys) - offsetof(FC85, sys)))
 
 /* ------------------------------------------------------------------------- */
 // System Api
@@ -204,7 +421,7 @@ static FC85 *fc85_Get();
 
 static void _interrupt(System *sys, byte code)
 {
-  FC85 *fc85 = fc85_Get();
+  FC85 *fc85 = fc85_FromSystem(sys);
   switch (code)
   {
     case INTERRUPT_CODE_DISK:
@@ -233,6 +450,32 @@ static void _clrHome(System *sys)
   sys->mem.home.cursorCol = 0;
 }
 
+static struct _inptEvent *_inptEvent(System *sys, byte index)
+{
+  return &sys->mem.inpt.events[index & (INPT_EVENT_RING_SIZE - 1)];
+}
+
+// presses of any of btns in this tick, each key event counts on its own
+static byte _inptPresses(System *sys, word btns)
+{
+  assert(sys);
+  byte presses = 0;
+  for (byte e = sys->mem.inpt.tail; e != sys->mem.inpt.head; e++)
+  {
+    struct _inptEvent *event = _inptEvent(sys, e);
+    if ((event->btn & btns) && (event->flags & INPT_EVENT_PRESS))
+      presses++;
+  }
+  return presses;
+}
+
+static void _clrRow(System *sys, byte row)
+{
+  assert(sys && row < DISP_CHAR_CELL_ROWS);
+  sys->mem.disp.flags |= DISP_FLAG_CHAR_MODE;
+  memset(sys->mem.disp.charCells[row], 0, sizeof(sys->mem.disp.charCells[row]));
+}
+
 static void _outputc(System *sys, byte row, byte col, byte value, byte flags)
 {
   assert(sys);
@@ -332,27 +575,33 @@ static void _pullInput(void *_, System *sys)
   }
   _outputc(sys, sys->mem.home.cursorRow, sys->mem.home.cursorCol,
     219, sys->mem.home.cursorOn  ? DISP_FLAG_NONE : DISP_FLAG_INVERT);
+
+  // RETURN completes the prompt and hands control back to the process that
+  // asked for it, ESC is handled by system_Tick popping this process
+  if (sys->mem.inpt.btns & INPT_BTN_RETN)
+  {
+    _outputc(sys, sys->mem.home.cursorRow, sys->mem.home.cursorCol, 0, DISP_FLAG_NONE);
+    sys->mem.home.inputStatus = HOME_INPUT_ACCEPTED;
+    system_PopProc(sys);
+  }
 }
 
-static bool _awaitInput(System *sys)
+static void _input(System *sys, byte *prompt)
 {
-  byte procCount = 0;
-  procCount = sys->procCount;
+  // the caller is suspended, not blocked: it returns from its tick and is
+  // resumed by the top-level loop once the prompt process is popped, then
+  // reads the outcome with _inputStatus
+  assert(sys);
+  _disp(sys, prompt ? prompt : (byte *)"?", false);
   memset(sys->mem.home.inputBuffer, 0, sizeof(sys->mem.home.inputBuffer));
-  system_PushProc(sys, NULL, _pullInput, NULL, NULL);
-  while (!system_IsShutdownFlagSet(sys) &&
-    !(sys->mem.inpt.btns & INPT_BTN_RETN) &&
-    sys->procCount - 1 == procCount)
-      tick();
-  system_PopProc(sys);
-  return procCount == sys->procCount;
+  sys->mem.home.inputStatus = HOME_INPUT_PENDING;
+  system_PushProc(sys, PROC_TYPE_INPUT, NULL, _pullInput, NULL, NULL);
 }
 
-static bool _input(System *sys, byte *prompt)
+static byte _inputStatus(System *sys)
 {
   assert(sys);
-  _disp(sys, prompt ? prompt : "?", false);
-  return _awaitInput(sys);
+  return sys->mem.home.inputStatus;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -366,6 +615,353 @@ static bool _input(System *sys, byte *prompt)
 #include "proc_create.h"
 #include "proc_edit.h"
 #include "proc_code.h"
+#include "lang.h"
+#include "proc_play.h"
+
+/* ------------------------------------------------------------------------- */
+// Process Types
+/* ------------------------------------------------------------------------- */
+
+// every process struct lives in a typed slab of this arena, allocated once
+// with the FC85, so pushing and popping processes never touches the heap.
+// A popped process keeps its slot until the end of the tick (it may still
+// be running), so a process that pops itself and pushes its own type in the
+// same tick needs a second slot.
+typedef struct _procArena {
+  byte used[PROC_TYPE_COUNT]; // bitmap of taken slots per slab
+  SysProcess sys[PROC_ARENA_SLOTS];
+  GamesProcess games[PROC_ARENA_SLOTS];
+  CreateProcess create[PROC_ARENA_SLOTS];
+  EditProcess edit[PROC_ARENA_SLOTS];
+  CodeProcess code[PROC_ARENA_SLOTS];
+  PlayProcess play[PROC_ARENA_SLOTS];
+} ProcessArena;
+
+#define PROC_SLAB(field) \
+  offsetof(ProcessArena, field), msizeof(ProcessArena, field[0]), PROC_ARENA_SLOTS
+
+// how each kind of process is written to and rebuilt from a snapshot, kinds
+// without a resume (the input prompt) are dropped and re-entered by their
+// caller instead
+static const ProcessType procTypes[PROC_TYPE_COUNT] = {
+  { "none", NULL, NULL, 0, 0, 0 },
+  { "input", NULL, NULL, 0, 0, 0 },
+  { "sys", sysProcess_Save, sysProcess_Resume, PROC_SLAB(sys) },
+  { "games", gamesProcess_Save, gamesProcess_Resume, PROC_SLAB(games) },
+  { "create", NULL, createProcess_Resume, PROC_SLAB(create) },
+  { "edit", editProcess_Save, editProcess_Resume, PROC_SLAB(edit) },
+  { "code", codeProcess_Save, codeProcess_Resume, PROC_SLAB(code) },
+  { "play", NULL, NULL, PROC_SLAB(play) },
+};
+
+/* ------------------------------------------------------------------------- */
+// Process Arena
+/* ------------------------------------------------------------------------- */
+
+static ProcessArena *processArena_Create()
+{
+  int slots = 0;
+  for (byte t = 0; t < PROC_TYPE_COUNT; t++)
+  {
+    assert(procTypes[t].capacity <= 8);
+    slots += procTypes[t].capacity;
+  }
+  assert(slots <= SYS_NUM_PROCESSES * 2); // live plus popped this tick
+
+  ProcessArena *self = (ProcessArena *)calloc(1, sizeof(ProcessArena));
+  assert(self);
+  return self;
+}
+
+static void processArena_Destroy(ProcessArena *self)
+{
+  assert(self);
+  memset(self, 0, sizeof(ProcessArena));
+  free(self);
+}
+
+static void processArena_Reset(ProcessArena *self)
+{
+  memset(self->used, 0, sizeof(self->used));
+}
+
+static void *processArena_Alloc(ProcessArena *self, byte type)
+{
+  assert(self);
+  assert(type < PROC_TYPE_COUNT);
+  const ProcessType *procType = &procTypes[type];
+  byte slot = 0;
+  while (slot < procType->capacity && (self->used[type] & (1 << slot)))
+    slot++;
+  assert(slot < procType->capacity);
+
+  self->used[type] |= (byte)(1 << slot);
+  byte *data = (byte *)self + procType->offset + slot * procType->size;
+  memset(data, 0, procType->size);
+  return data;
+}
+
+static void processArena_Release(ProcessArena *self, byte type, void *data)
+{
+  assert(self);
+  assert(type < PROC_TYPE_COUNT);
+  const ProcessType *procType = &procTypes[type];
+  byte *slab = (byte *)self + procType->offset;
+  // processes that brought their own data (templates, the input prompt)
+  // are not the arena's to release
+  if ((byte *)data < slab || (byte *)data >= slab + procType->capacity * procType->size)
+    return;
+
+  size_t slot = ((byte *)data - slab) / procType->size;
+  self->used[type] &= (byte)~(1 << slot);
+}
+
+static void processArena_Report()
+{
+  printf("[FC-85]  process arena: total:%zd", sizeof(ProcessArena));
+  for (byte t = 0; t < PROC_TYPE_COUNT; t++)
+    if (procTypes[t].capacity)
+      printf(", %s:%zdx%d", procTypes[t].name, procTypes[t].size, procTypes[t].capacity);
+  printf("\n");
+}
+
+/* ------------------------------------------------------------------------- */
+// Save States
+/* ------------------------------------------------------------------------- */
+
+// a raw copy of the machine and its process slabs, the process stack keeps
+// its function and data pointers so a state only loads back into the
+// System it was taken from, within the same run (files use a Snapshot).
+// A playing game keeps its state in a Lua heap outside system memory, so
+// no state is taken while one is on the stack.
+typedef struct _saveState {
+  bool valid;
+  System sys;
+  ProcessArena procArena;
+} SaveState;
+
+static SaveState *saveState_Create()
+{
+  SaveState *self = (SaveState *)calloc(1, sizeof(SaveState));
+  assert(self);
+  return self;
+}
+
+static void saveState_Destroy(SaveState *self)
+{
+  assert(self);
+  memset(self, 0, sizeof(SaveState));
+  free(self);
+}
+
+static bool system_SaveState(System *self, SaveState *state)
+{
+  // dead processes are reaped at the end of every tick
+  assert(self->deadProcCount == 0);
+  for (byte p = 0; p < self->procCount; p++)
+    if (self->procStack[p].type == PROC_TYPE_PLAY)
+      return false;
+  memcpy(&state->sys, self, sizeof(System));
+  memcpy(&state->procArena, self->procArena, sizeof(ProcessArena));
+  state->valid = true;
+  return true;
+}
+
+static bool system_LoadState(System *self, const SaveState *state)
+{
+  if (!state->valid || state->sys.procArena != self->procArena)
+    return false;
+  // the slabs are overwritten below, this only lets go of host resources
+  system_DestroyProcs(self);
+  memcpy(self, &state->sys, sizeof(System));
+  memcpy(self->procArena, &state->procArena, sizeof(ProcessArena));
+  // whatever was pressed when the state was taken has been handled
+  self->mem.inpt.btns = 0;
+  memset(self->mem.inpt.text, 0, sizeof(self->mem.inpt.text));
+  self->mem.inpt.tail = self->mem.inpt.head;
+  return true;
+}
+
+/* ------------------------------------------------------------------------- */
+// Rewind
+/* ------------------------------------------------------------------------- */
+
+// the newest frame is kept whole and every older one as the XOR against
+// the frame after it, so stepping back is applying the newest delta to the
+// current frame. Deltas are runs of [word skip][word count][count dwords]
+// and live in a byte ring that drops the oldest frames when it fills.
+typedef struct _rewind {
+  SaveState *current;
+  SaveState *scratch;
+  bool primed;
+  byte *encoded;    // worst case delta of one frame
+  byte *data;
+  dword head;       // where the next delta goes
+  word first;       // oldest frame
+  word count;
+  struct _rewindFrame {
+    dword offset;
+    dword size;
+  } frames[SYS_REWIND_FRAMES];
+  dword captured;   // frames and delta bytes since startup, for the report
+  double capturedBytes;
+} Rewind;
+
+#define REWIND_WORDS (sizeof(SaveState) / sizeof(dword))
+
+static Rewind *rewind_Create()
+{
+  assert(sizeof(SaveState) % sizeof(dword) == 0);
+  Rewind *self = (Rewind *)calloc(1, sizeof(Rewind));
+  assert(self);
+  self->current = saveState_Create();
+  self->scratch = saveState_Create();
+  self->encoded = (byte *)malloc(REWIND_WORDS * 8 + 8);
+  self->data = (byte *)malloc(SYS_REWIND_BUFFER_SIZE);
+  assert(self->encoded && self->data);
+  return self;
+}
+
+static void rewind_Destroy(Rewind *self)
+{
+  assert(self);
+  saveState_Destroy(self->current);
+  saveState_Destroy(self->scratch);
+  free(self->encoded);
+  free(self->data);
+  memset(self, 0, sizeof(Rewind));
+  free(self);
+}
+
+static dword rewind_Encode(const dword *cur, const dword *prev, dword words, byte *out)
+{
+  byte *o = out;
+  dword i = 0;
+  while (i < words)
+  {
+    dword start = i;
+    while (i < words && cur[i] == prev[i] && i - start < 0xFFFF)
+      i++;
+    word skip = (word)(i - start);
+
+    start = i;
+    while (i < words && cur[i] != prev[i] && i - start < 0xFFFF)
+      i++;
+    word count = (word)(i - start);
+    if (count == 0 && i == words)
+      break;
+
+    memcpy(o, &skip, sizeof(skip));
+    memcpy(o + 2, &count, sizeof(count));
+    o += 4;
+    for (dword w = start; w < i; w++, o += 4)
+    {
+      dword x = cur[w] ^ prev[w];
+      memcpy(o, &x, sizeof(x));
+    }
+  }
+  return (dword)(o - out);
+}
+
+// false when a run would leave the delta or the image, the image is then
+// only partly stepped back
+static bool rewind_Apply(dword *image, dword words, const byte *delta, dword size)
+{
+  const byte *end = delta + size;
+  dword i = 0;
+  while (delta < end)
+  {
+    word skip, count;
+    if (end - delta < 4)
+      return false;
+    memcpy(&skip, delta, sizeof(skip));
+    memcpy(&count, delta + 2, sizeof(count));
+    delta += 4;
+    i += skip;
+    if (i + count > words || (dword)(end - delta) < (dword)count * 4)
+      return false;
+    for (word w = 0; w < count; w++, delta += 4)
+    {
+      dword x;
+      memcpy(&x, delta, sizeof(x));
+      image[i++] ^= x;
+    }
+  }
+  return true;
+}
+
+static void rewind_Append(Rewind *self, const byte *delta, dword size)
+{
+  assert(size <= SYS_REWIND_BUFFER_SIZE);
+  if (self->head + size > SYS_REWIND_BUFFER_SIZE)
+    self->head = 0;
+
+  // a frame only steps back through every newer one, so everything up to
+  // the newest frame the write lands on goes. After a wrap that is not the
+  // oldest frame: the ones left past head from the last lap are older still
+  word evict = self->count == SYS_REWIND_FRAMES ? 1 : 0;
+  for (word f = 0; f < self->count; f++)
+  {
+    const struct _rewindFrame *frame = &self->frames[(self->first + f) % SYS_REWIND_FRAMES];
+    if (frame->offset < self->head + size && frame->offset + frame->size > self->head)
+      evict = f + 1;
+  }
+  self->first = (self->first + evict) % SYS_REWIND_FRAMES;
+  self->count -= evict;
+
+  struct _rewindFrame *frame = &self->frames[(self->first + self->count) % SYS_REWIND_FRAMES];
+  frame->offset = self->head;
+  frame->size = size;
+  memcpy(self->data + self->head, delta, size);
+  self->head += size;
+  self->count++;
+}
+
+static void rewind_Capture(Rewind *self, System *sys)
+{
+  if (!system_SaveState(sys, self->scratch))
+    return;
+  if (self->primed)
+  {
+    dword size = rewind_Encode((const dword *)self->scratch,
+      (const dword *)self->current, REWIND_WORDS, self->encoded);
+    rewind_Append(self, self->encoded, size);
+    self->captured++;
+    self->capturedBytes += size;
+  }
+
+  SaveState *newest = self->scratch;
+  self->scratch = self->current;
+  self->current = newest;
+  self->primed = true;
+}
+
+static bool rewind_StepBack(Rewind *self, System *sys)
+{
+  if (self->count == 0)
+    return false;
+
+  struct _rewindFrame *newest = &self->frames[(self->first + self->count - 1) % SYS_REWIND_FRAMES];
+  if (!rewind_Apply((dword *)self->current, REWIND_WORDS, self->data + newest->offset, newest->size))
+  {
+    printf("[FC-85] rewind history is damaged, dropped\n");
+    self->count = 0;
+    self->primed = false;
+    return false;
+  }
+  self->head = newest->offset;
+  self->count--;
+  return system_LoadState(sys, self->current);
+}
+
+static void rewind_Report(Rewind *self)
+{
+  dword bytes = 0;
+  for (word f = 0; f < self->count; f++)
+    bytes += self->frames[(self->first + f) % SYS_REWIND_FRAMES].size;
+  printf("[FC-85] rewind: %u frames held in %u bytes, %.0f bytes per frame on average\n",
+    self->count, bytes, self->captured ? self->capturedBytes / self->captured : 0.0);
+}
 
 /* ------------------------------------------------------------------------- */
 // FC85
@@ -375,49 +971,257 @@ static FC85 *fc85_Create()
 {
   FC85 *self = NULL;
   self = (FC85 *)calloc(1, sizeof(FC85));
+  assert(self);
+  self->sys.procArena = processArena_Create();
+#ifdef FC85_PROFILE
+  self->prof.frequency = SDL_GetPerformanceFrequency();
+  self->sys.prof = &self->prof;
+#endif
   return self;
 }
 
 static void fc85_Destroy(FC85 *self) 
 {
+  system_DestroyProcs(&self->sys);
+  if (self->saveState)
+    saveState_Destroy(self->saveState);
+  if (self->rewind)
+    rewind_Destroy(self->rewind);
+  processArena_Destroy(self->sys.procArena);
   memset(self, 0, sizeof(FC85));
   free(self);
 }
 
-static FC85 *fc85_Get()
+/* ------------------------------------------------------------------------- */
+// File Mapping
+/* ------------------------------------------------------------------------- */
+
+static void *_mapFile(const char *fileName, size_t size)
+{
+  void *view = NULL;
+#ifdef _WIN32
+  HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return NULL;
+  if (GetFileSize(file, NULL) >= size)
+  {
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL)
+    {
+      view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+      CloseHandle(mapping);
+    }
+  }
+  CloseHandle(file);
+#else
+  struct stat st;
+  int fd = open(fileName, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= size)
+  {
+    view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    view = view == MAP_FAILED ? NULL : view;
+  }
+  close(fd);
+#endif
+  return view;
+}
+
+static void _unmapFile(void *view, size_t size)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(view);
+#else
+  munmap(view, size);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+// Histograms
+/* ------------------------------------------------------------------------- */
+
+// log-linear buckets, exact below 4us and then 4 steps per power of two
+static byte histogram_Bucket(dword us)
+{
+  if (us < 4)
+    return (byte)us;
+  byte msb = 0;
+  while ((us >> (msb + 1)) != 0)
+    msb++;
+  int bucket = (msb - 1) * 4 + ((us >> (msb - 2)) & 3);
+  return (byte)min(bucket, PROFILE_BUCKETS - 1);
+}
+
+static dword histogram_BucketValue(byte bucket)
+{
+  if (bucket < 4)
+    return bucket;
+  return (dword)(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+static void histogram_Add(Histogram *self, dword us)
+{
+  byte bucket = histogram_Bucket(us);
+  if (self->count == PROFILE_WINDOW)
+    self->window[self->recent[self->next]]--;
+  else
+    self->count++;
+  self->recent[self->next] = bucket;
+  self->next = (self->next + 1) % PROFILE_WINDOW;
+  self->window[bucket]++;
+  self->total[bucket]++;
+  self->samples++;
+  self->max = us > self->max ? us : self->max;
+}
+
+static dword histogram_Percentile(const Histogram *self, bool rolling, byte percent)
+{
+  dword count = rolling ? self->count : self->samples;
+  dword rank = (count * percent + 99) / 100;
+  dword seen = 0;
+  if (count == 0)
+    return 0;
+  for (byte b = 0; b < PROFILE_BUCKETS; b++)
+  {
+    seen += rolling ? self->window[b] : self->total[b];
+    if (seen >= rank)
+      return histogram_BucketValue(b);
+  }
+  return histogram_BucketValue(PROFILE_BUCKETS - 1);
+}
+
+/* ------------------------------------------------------------------------- */
+// Profiler
+/* ------------------------------------------------------------------------- */
+
+#ifdef FC85_PROFILE
+
+static void profiler_Begin(Profiler *self, byte stage)
+{
+  self->stages[stage].start = SDL_GetPerformanceCounter();
+}
+
+static void profiler_End(Profiler *self, byte stage)
+{
+  Uint64 elapsed = SDL_GetPerformanceCounter() - self->stages[stage].start;
+  histogram_Add(&self->stages[stage], (dword)(elapsed * 1000000 / self->frequency));
+}
+
+static const char *profiler_StageName(byte stage)
 {
-  static void fc85_Cleanup(void);
+  static const char *names[PROFILE_STAGE_PROC] = {
+    "frame", "input", "system", "display", "disk" };
+  return stage < PROFILE_STAGE_PROC ? names[stage] : procTypes[stage - PROFILE_STAGE_PROC].name;
+}
+
+// 3 characters: microseconds, then milliseconds, then seconds
+static void profiler_FormatTime(dword us, char *text)
+{
+  if (us < 1000)
+    snprintf(text, 4, "%3u", us);
+  else if (us < 100000)
+    snprintf(text, 4, "%2um", us / 1000);
+  else
+    snprintf(text, 4, "%2us", min(us / 1000000, 99));
+}
 
-  if (_fc85 == NULL)
+static void profiler_DrawText(System *sys, int *pixels, byte row, const char *text)
+{
+  // drawn inverted straight into the host frame, system memory is untouched
+  for (byte c = 0; c < DISP_CHAR_CELL_COLS && text[c] != '\0'; c++)
   {
-    _fc85 = fc85_Create();
-    atexit(fc85_Cleanup);
+    byte *fontChar = sys->mem.disp.font[(byte)text[c]];
+    for (int cy = 0; cy < DISP_CHAR_HEIGHT_PIXELS; cy++)
+    for (int cx = 0; cx < DISP_CHAR_WIDTH_PIXELS; cx++)
+    {
+      bool on = fontChar[cy] & (0x80 >> cx);
+      int y = row * DISP_CHAR_HEIGHT_PIXELS + cy;
+      int x = c * DISP_CHAR_WIDTH_PIXELS + cx;
+      pixels[y * DISP_WIDTH_PIXELS + x] = on
+        ? sys->mem.disp.background.value
+        : sys->mem.disp.foreground.value;
+    }
   }
+}
+
+static void profiler_DrawOverlay(Profiler *self, System *sys, int *pixels)
+{
+  char text[DISP_CHAR_CELL_COLS + 1];
+  char p50[4], p95[4], p99[4], p95b[4], p95c[4], p95d[4];
+  if (!self->overlay)
+    return;
 
-  assert(_fc85);
-  return _fc85;
+  Histogram *frame = &self->stages[PROFILE_STAGE_FRAME];
+  profiler_FormatTime(histogram_Percentile(frame, true, 50), p50);
+  profiler_FormatTime(histogram_Percentile(frame, true, 95), p95);
+  profiler_FormatTime(histogram_Percentile(frame, true, 99), p99);
+  snprintf(text, sizeof(text), "frm %s %s %s", p50, p95, p99);
+  profiler_DrawText(sys, pixels, DISP_CHAR_CELL_ROWS - 3, text);
+
+  profiler_FormatTime(histogram_Percentile(&self->stages[PROFILE_STAGE_INPUT], true, 95), p95);
+  profiler_FormatTime(histogram_Percentile(&self->stages[PROFILE_STAGE_SYSTEM], true, 95), p95b);
+  profiler_FormatTime(histogram_Percentile(&self->stages[PROFILE_STAGE_DISPLAY], true, 95), p95c);
+  profiler_FormatTime(histogram_Percentile(&self->stages[PROFILE_STAGE_DISK], true, 95), p95d);
+  snprintf(text, sizeof(text), "I%sS%sD%sK%s", p95, p95b, p95c, p95d);
+  profiler_DrawText(sys, pixels, DISP_CHAR_CELL_ROWS - 2, text);
+
+  if (sys->procCount > 0)
+  {
+    byte stage = PROFILE_STAGE_PROC + sys->procStack[sys->procCount - 1].type;
+    Histogram *proc = &self->stages[stage];
+    profiler_FormatTime(histogram_Percentile(proc, true, 50), p50);
+    profiler_FormatTime(histogram_Percentile(proc, true, 95), p95);
+    profiler_FormatTime(histogram_Percentile(proc, true, 99), p99);
+    snprintf(text, sizeof(text), "%-4.4s%s %s %s", profiler_StageName(stage), p50, p95, p99);
+    profiler_DrawText(sys, pixels, DISP_CHAR_CELL_ROWS - 1, text);
+  }
 }
 
-static void fc85_Cleanup(void)
+static void profiler_DumpRow(FILE *fp, const char *name, Histogram *hist)
 {
-  if (!_fc85)
+  if (hist->samples == 0)
     return;
+  fprintf(fp, "%-8s %10u %8u %8u %8u %8u\n",
+    name, hist->samples,
+    histogram_Percentile(hist, false, 50),
+    histogram_Percentile(hist, false, 95),
+    histogram_Percentile(hist, false, 99),
+    hist->max);
+}
 
-  fc85_Destroy(_fc85);
-  _fc85 = NULL;
+static void profiler_Dump(Profiler *self, const char *fileName)
+{
+  FILE *fp = fopen(fileName, "w");
+  if (fp == NULL)
+    return;
+  fprintf(fp, "%-8s %10s %8s %8s %8s %8s\n",
+    "stage", "samples", "p50(us)", "p95(us)", "p99(us)", "max(us)");
+  for (byte s = 0; s < PROFILE_STAGE_COUNT; s++)
+    profiler_DumpRow(fp, profiler_StageName(s), &self->stages[s]);
+  profiler_DumpRow(fp, "compiled", &self->compiled);
+  profiler_DumpRow(fp, "cached", &self->cached);
+  fprintf(fp, "game heap peak %zu of %u bytes, %u failed allocations\n",
+    self->heapPeak, PLAY_HEAP_SIZE, self->heapFailures);
+  fclose(fp);
 }
 
+#endif
+
 /* ------------------------------------------------------------------------- */
 // System
 /* ------------------------------------------------------------------------- */
 
-static void system_PushProc(System *self, void *data, void (*tick)(void *, void *), void (*restore)(void *, void *), void (*destroy)(void *))
+static void system_PushProc(System *self, byte type, void *data, void (*tick)(void *, void *), void (*restore)(void *, void *), void (*destroy)(void *))
 {
   assert(self->procCount < SYS_NUM_PROCESSES);
+  assert(type < PROC_TYPE_COUNT);
   Process *procSlot = (Process *)&self->procStack[self->procCount];
   self->procCount++;
 
   memset(procSlot, 0, sizeof(Process));
+  procSlot->type = type;
   procSlot->data = data;
   procSlot->tick = tick;
   procSlot->restore = restore;
@@ -431,6 +1235,9 @@ static void system_PopProc(System *self)
   memcpy(&self->deadProcStack[self->deadProcCount],
     &self->procStack[self->procCount - 1],
     sizeof(Process));
+  if (self->procStack[self->procCount - 1].type == PROC_TYPE_INPUT &&
+    self->mem.home.inputStatus == HOME_INPUT_PENDING)
+    self->mem.home.inputStatus = HOME_INPUT_CANCELLED;
   self->procCount--;
   self->deadProcCount++;
 
@@ -444,9 +1251,24 @@ static void system_PopProc(System *self)
     }
 }
 
-static void system_Boot(System *self) 
+// clears the machine but keeps what the host attached to it
+static void system_Reset(System *self)
 {
+  ProcessArena *procArena = self->procArena;
+#ifdef FC85_PROFILE
+  Profiler *prof = self->prof;
+#endif
   memset(self, 0, sizeof(System));
+  self->procArena = procArena;
+#ifdef FC85_PROFILE
+  self->prof = prof;
+#endif
+  processArena_Reset(procArena);
+}
+
+static void system_Boot(System *self) 
+{
+  system_Reset(self);
 
   self->mem.disp.foreground.value = DISP_DEFAULT_FG_COL;
   self->mem.disp.background.value = DISP_DEFAULT_BG_COL;
@@ -476,36 +1298,151 @@ static void system_Tick(System *self)
     return;
   }
 
-  if (self->procCount > 1)
+  // an escaped process is still reaped this tick so its slot is free for
+  // whatever the next tick pushes
+  if (self->procCount > 1 && (self->mem.inpt.btns & INPT_BTN_ESCP))
   {
-    if (self->mem.inpt.btns & INPT_BTN_ESCP) {
-      system_PopProc(self);
-      return;
-    }
+    system_PopProc(self);
   }
-
-  if (self->procCount > 0) 
+  else if (self->procCount > 0) 
   {
     Process *proc = (Process *)&self->procStack[self->procCount - 1];
+#ifdef FC85_PROFILE
+    byte type = proc->type; // the stack slot may be reused by the tick
+#endif
+    PROFILE_BEGIN(self->prof, PROFILE_STAGE_PROC + type);
     if (proc->tick)
       proc->tick(proc->data, self);
+    PROFILE_END(self->prof, PROFILE_STAGE_PROC + type);
   }
 
+  // every process has had its look at this tick's events
+  self->mem.inpt.tail = self->mem.inpt.head;
+
   while (self->deadProcCount > 0) 
   {
     self->deadProcCount--;
     Process *deadProc = (Process *)&self->deadProcStack[self->deadProcCount];
     if (deadProc->destroy) deadProc->destroy(deadProc->data);
+    processArena_Release(self->procArena, deadProc->type, deadProc->data);
     memset(deadProc, 0, sizeof(Process));
   }
 }
 
+// Snapshots restore memory and process state byte for byte, so they only
+// make sense to the build that took them: this hashes the shape of both.
+static dword system_Layout(void)
+{
+  const size_t shape[] = {
+    sizeof(struct _sys), offsetof(struct _sys, delta), offsetof(struct _sys, clock),
+    sizeof(struct _disp), offsetof(struct _disp, buffer), offsetof(struct _disp, charCells), offsetof(struct _disp, font),
+    sizeof(struct _home), offsetof(struct _home, cursorTimer), offsetof(struct _home, inputBuffer),
+    sizeof(struct _disk), offsetof(struct _disk, size), offsetof(struct _disk, name), offsetof(struct _disk, buffer),
+    sizeof(struct _inpt), offsetof(struct _inpt, head), offsetof(struct _inpt, events), sizeof(struct _inptEvent),
+    offsetof(System, mem.disp), offsetof(System, mem.home), offsetof(System, mem.disk),
+    offsetof(System, mem.inpt), offsetof(System, mem.appl),
+    sizeof(ProcessDescriptor), PROC_STATE_SIZE, SYS_NUM_PROCESSES, PROC_TYPE_COUNT,
+  };
+  dword hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(shape) / sizeof(shape[0]); i++)
+  {
+    hash ^= (dword)shape[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void system_Snapshot(System *self, Snapshot *snapshot)
+{
+  memset(snapshot, 0, sizeof(Snapshot));
+  snapshot->magic = SYS_SNAPSHOT_MAGIC;
+  snapshot->memSize = sizeof(self->mem);
+  snapshot->layout = system_Layout();
+  memcpy(snapshot->mem, &self->mem, sizeof(self->mem));
+  for (byte p = 0; p < self->procCount; p++)
+  {
+    Process *proc = &self->procStack[p];
+    const ProcessType *type = &procTypes[proc->type];
+    if (!type->resume)
+      continue;
+
+    ProcessDescriptor *desc = &snapshot->procs[snapshot->procCount];
+    snapshot->procCount++;
+    desc->type = proc->type;
+    if (type->save)
+      type->save(proc->data, self, desc->state);
+  }
+}
+
+static void system_DestroyProcs(System *self)
+{
+  while (self->procCount > 0)
+  {
+    self->procCount--;
+    Process *proc = &self->procStack[self->procCount];
+    if (proc->destroy) proc->destroy(proc->data);
+  }
+}
+
+static bool system_Resume(System *self, const Snapshot *snapshot)
+{
+  if (snapshot->magic != SYS_SNAPSHOT_MAGIC ||
+    snapshot->memSize != sizeof(self->mem) ||
+    snapshot->layout != system_Layout() ||
+    snapshot->procCount == 0 ||
+    snapshot->procCount > SYS_NUM_PROCESSES)
+    return false;
+
+  system_DestroyProcs(self);
+  system_Reset(self);
+  memcpy(&self->mem, snapshot->mem, sizeof(self->mem));
+  self->mem.sys.flags &= (byte)~SYS_FLAG_SHUTDOWN;
+  memset(&self->mem.inpt, 0, sizeof(self->mem.inpt));
+
+  for (byte p = 0; p < snapshot->procCount; p++)
+  {
+    const ProcessDescriptor *desc = &snapshot->procs[p];
+    if (desc->type < PROC_TYPE_COUNT && procTypes[desc->type].resume)
+      procTypes[desc->type].resume(self, desc->state);
+  }
+  return self->procCount > 0;
+}
+
+static void system_Hibernate(System *self, const char *fileName)
+{
+  Snapshot *snapshot = (Snapshot *)calloc(1, sizeof(Snapshot));
+  assert(snapshot);
+  system_Snapshot(self, snapshot);
+  FILE *fp = fopen(fileName, "wb");
+  assert(fp != NULL);
+  fwrite(snapshot, sizeof(Snapshot), 1, fp);
+  fclose(fp);
+  free(snapshot);
+}
+
+static bool system_Wake(System *self, const char *fileName)
+{
+  Snapshot *snapshot = (Snapshot *)_mapFile(fileName, sizeof(Snapshot));
+  if (!snapshot)
+    return false;
+  if (snapshot->magic == SYS_SNAPSHOT_MAGIC && snapshot->layout != system_Layout())
+    printf("[FC-85] %s was saved by a different build, not loaded\n", fileName);
+  bool resumed = system_Resume(self, snapshot);
+  _unmapFile(snapshot, sizeof(Snapshot));
+  return resumed;
+}
+
 /* ------------------------------------------------------------------------- */
 // DisplayDevice
 /* ------------------------------------------------------------------------- */
 
-void displayDevice_Initialize(DisplayDevice *self) 
+void displayDevice_Initialize(DisplayDevice *self, bool headless) 
 {
+  memset(self, 0, sizeof(DisplayDevice));
+  self->headless = headless;
+  if (headless)
+    return;
+
   int sdlInit = SDL_Init(SDL_INIT_VIDEO);
   assert(sdlInit >= 0);
 
@@ -528,6 +1465,8 @@ void displayDevice_Initialize(DisplayDevice *self)
 
 void displayDevice_Dispose(DisplayDevice *self) 
 {
+  if (self->headless)
+    return;
   SDL_DestroyTexture(self->texture);
   SDL_DestroyRenderer(self->renderer);  
   SDL_DestroyWindow(self->window);
@@ -536,7 +1475,7 @@ void displayDevice_Dispose(DisplayDevice *self)
 
 void displayDevice_Interrupt(DisplayDevice *self, System *sys) 
 {
-  static int pixels[DISP_WIDTH_PIXELS * DISP_HEIGHT_PIXELS];
+  int *pixels = self->pixels;
 
   if (sys->mem.disp.flags & DISP_FLAG_CHAR_MODE)
   {
@@ -558,9 +1497,6 @@ void displayDevice_Interrupt(DisplayDevice *self, System *sys)
     }
   }
 
-  SDL_SetRenderDrawColor(self->renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-  SDL_RenderClear(self->renderer);
-
   int pixel = 0;
   for (int y = 0; y < DISP_HEIGHT_PIXELS; ++y)
   for (int x = 0; x < DISP_WIDTH_PIXELS; ++x, pixel++)
@@ -571,77 +1507,292 @@ void displayDevice_Interrupt(DisplayDevice *self, System *sys)
       : sys->mem.disp.background.value;
   }
 
+#ifdef FC85_PROFILE
+  profiler_DrawOverlay(sys->prof, sys, pixels);
+#endif
+  if (self->headless)
+  {
+    self->presented = SDL_GetPerformanceCounter();
+    return;
+  }
+
+  SDL_SetRenderDrawColor(self->renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+  SDL_RenderClear(self->renderer);
   SDL_UpdateTexture(self->texture, NULL, pixels, DISP_WIDTH_PIXELS * 4);
   SDL_RenderCopy(self->renderer, self->texture, NULL, NULL);
   SDL_RenderPresent(self->renderer);
+  self->presented = SDL_GetPerformanceCounter();
 }
 
 /* ------------------------------------------------------------------------- */
 // DiskDevice
 /* ------------------------------------------------------------------------- */
 
-static void diskDevice_Initialize(DiskDevice *self)
+static void diskImage_Save(const DiskImage *image, const char *fileName)
 {
-  FILE *fp = fopen(DISK_FILE_NAME, "rb");
-  assert(sizeof(DiskDevice) == DISK_SIZE);
-  assert(msizeof(DiskDevice, hdr) == (DISK_BLOCK_SIZE * 2));
-  if (fp == NULL)
-  {
-    printf("[FC-85] no disk file "DISK_FILE_NAME", creating...\n");
-    fp = fopen(DISK_FILE_NAME, "wb");
-    assert(fp != NULL);
-    memset(self, 0, sizeof(DiskDevice));
-    self->hdr.blockMap[0] |= 0xC0; // 1100 0000 2 blocks for header
-    for (int b = 0; b < sizeof(DiskDevice); b++)
-      fputc(self->raw[b], fp);
-    fclose(fp);
-    printf("[FC-85] disk file created\n");
-    fp = fopen(DISK_FILE_NAME, "rb");
-  }
+  FILE *fp = fopen(fileName, "wb");
   assert(fp != NULL);
-  printf("[FC-85] loading disk from "DISK_FILE_NAME"...\n");
-  
-  
-  for (int b = 0; b < sizeof(DiskDevice); b++)
-  {
-    self->raw[b] = fgetc(fp);
-    assert(self->raw[b] != EOF);
+  for (int b = 0; b < sizeof(DiskImage); b++)
+    fputc(image->raw[b], fp);
+  fclose(fp);
+}
+
+static void diskImage_SaveHeader(const struct _header *hdr, const char *fileName)
+{
+  FILE *fp = fopen(fileName, "r+b");
+  assert(fp != NULL);
+  fwrite(hdr, sizeof(struct _header), 1, fp);
+  fclose(fp);
+}
+
+// the image is written next to the file and moved over it in one step, so
+// consoles still mapping the old file keep reading it undisturbed
+static bool diskImage_Replace(const DiskImage *image, const char *fileName)
+{
+  char tempName[DISK_MOUNT_PATH_SIZE + 4];
+  snprintf(tempName, sizeof(tempName), "%s.tmp", fileName);
+  FILE *fp = fopen(tempName, "wb");
+  if (fp == NULL)
+    return false;
+  bool written = fwrite(image, sizeof(DiskImage), 1, fp) == 1;
+  written = fclose(fp) == 0 && written;
+#ifdef _WIN32
+  bool replaced = written &&
+    MoveFileExA(tempName, fileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+  bool replaced = written && rename(tempName, fileName) == 0;
+#endif
+  if (!replaced)
+    remove(tempName);
+  return replaced;
+}
+
+static bool diskImage_Matches(const DiskImage *image, const char *fileName)
+{
+  DiskImage *current = (DiskImage *)calloc(1, sizeof(DiskImage));
+  assert(current);
+  FILE *fp = fopen(fileName, "rb");
+  bool matches = fp && fread(current, sizeof(DiskImage), 1, fp) == 1 &&
+    memcmp(current, image, sizeof(DiskImage)) == 0;
+  if (fp)
+    fclose(fp);
+  free(current);
+  return matches;
+}
+
+static DiskImage *diskImage_Map(const char *fileName)
+{
+  DiskImage *image = (DiskImage *)_mapFile(fileName, sizeof(DiskImage));
+  assert(image);
+  return image;
+}
+
+static void diskImage_Unmap(DiskImage *image)
+{
+  _unmapFile(image, sizeof(DiskImage));
+}
+
+static bool diskMount_Initialize(DiskMount *self, const char *fileName, bool readOnly, bool overlay)
+{
+  assert(sizeof(DiskImage) == DISK_SIZE);
+  assert(msizeof(DiskImage, hdr) == (DISK_BLOCK_SIZE * 2));
+  assert(sizeof(struct _file) == 64);
+  memset(self, 0, sizeof(DiskMount));
+  strncpy(self->fileName, fileName, sizeof(self->fileName) - 1);
+  self->isReadOnly = readOnly;
+
+  FILE *fp = fopen(fileName, "rb");
+  if (fp == NULL)
+  {
+    if (readOnly)
+    {
+      printf("[FC-85] no disk file %s, skipping\n", fileName);
+      return false;
+    }
+    printf("[FC-85] no disk file %s, creating...\n", fileName);
+    DiskImage *image = (DiskImage *)calloc(1, sizeof(DiskImage));
+    assert(image);
+    image->hdr.blockMap[0] |= 0xC0; // 1100 0000 2 blocks for header
+    diskImage_Save(image, fileName);
+    free(image);
+    printf("[FC-85] disk file created\n");
+    fp = fopen(fileName, "rb");
+  }
+  assert(fp != NULL);
+
+  if (overlay || readOnly)
+  {
+    // the base image is mapped read-only and shared by every console booted
+    // against it, this console's writes go to private copy-on-write blocks
+    fclose(fp);
+    printf("[FC-85] mapping disk from %s%s...\n", fileName,
+      readOnly ? " read-only" : " as overlay");
+    self->isOverlay = !readOnly;
+    self->image = diskImage_Map(fileName);
+    self->hdr = (struct _header *)calloc(1, sizeof(struct _header));
+    assert(self->hdr);
+    memcpy(self->hdr, &self->image->hdr, sizeof(struct _header));
+    printf("[FC-85] disk mapped\n");
+    return true;
+  }
+
+  printf("[FC-85] loading disk from %s...\n", fileName);
+  self->image = (DiskImage *)calloc(1, sizeof(DiskImage));
+  assert(self->image);
+  self->hdr = &self->image->hdr;
+  for (int b = 0; b < sizeof(DiskImage); b++)
+  {
+    int c = fgetc(fp);
+    assert(c != EOF);
+    self->image->raw[b] = (byte)c;
   }
 
   printf("[FC-85] disk loaded\n");
   fclose(fp);
+  return true;
 }
 
-static void diskDevice_Write(DiskDevice *self, System *sys)
+static void diskMount_DiscardOverlay(DiskMount *self)
 {
-  assert(self && sys);
-  const byte *fileName = sys->mem.disk.name;
-  const dword size = (dword)min(sizeof(sys->mem.disk.buffer), strlen(sys->mem.disk.buffer));
-  const byte *data = sys->mem.disk.buffer;
+  assert(self);
+  if (!self->isOverlay)
+    return;
+
+  for (int b = 0; b < DISK_BLOCK_COUNT; b++)
+  {
+    free(self->overlay[b]);
+    self->overlay[b] = NULL;
+  }
+  memcpy(self->hdr, &self->image->hdr, sizeof(struct _header));
+}
+
+// refused when another console merged into the base since this one mapped
+// it, its changes would be lost under these
+static void diskMount_MergeOverlay(DiskMount *self)
+{
+  assert(self);
+  if (!self->isOverlay)
+    return;
+
+  if (!diskImage_Matches(self->image, self->fileName))
+  {
+    printf("[FC-85] %s changed since it was mapped, overlay not merged\n", self->fileName);
+    return;
+  }
+
+  DiskImage *merged = (DiskImage *)calloc(1, sizeof(DiskImage));
+  assert(merged);
+  memcpy(merged, self->image, sizeof(DiskImage));
+  memcpy(&merged->hdr, self->hdr, sizeof(struct _header));
+  for (int b = 0; b < DISK_BLOCK_COUNT; b++)
+    if (self->overlay[b])
+      memcpy(merged->blocks[b], self->overlay[b], DISK_BLOCK_SIZE);
+
+  // Windows will not replace a file this process still maps
+  diskImage_Unmap(self->image);
+  bool replaced = diskImage_Replace(merged, self->fileName);
+  free(merged);
+  self->image = diskImage_Map(self->fileName);
+  if (!replaced)
+  {
+    printf("[FC-85] %s could not be replaced, overlay not merged\n", self->fileName);
+    return;
+  }
+  diskMount_DiscardOverlay(self);
+}
+
+static void diskMount_Dispose(DiskMount *self)
+{
+  assert(self);
+  if (self->isOverlay || self->isReadOnly)
+  {
+    diskMount_DiscardOverlay(self);
+    diskImage_Unmap(self->image);
+    free(self->hdr);
+  }
+  else
+  {
+    free(self->image);
+  }
+  memset(self, 0, sizeof(DiskMount));
+}
+
+static const byte *diskMount_ReadBlock(DiskMount *self, byte block)
+{
+  if (self->overlay[block])
+    return self->overlay[block];
+  return self->image->blocks[block];
+}
+
+static byte *diskMount_WriteBlock(DiskMount *self, byte block)
+{
+  assert(!self->isReadOnly);
+  if (!self->isOverlay)
+    return self->image->blocks[block];
+
+  if (!self->overlay[block])
+  {
+    self->overlay[block] = (byte *)malloc(DISK_BLOCK_SIZE);
+    assert(self->overlay[block]);
+    memcpy(self->overlay[block], self->image->blocks[block], DISK_BLOCK_SIZE);
+  }
+  return self->overlay[block];
+}
+
+static bool diskMount_Fits(DiskMount *self, const byte *fileName, dword size)
+{
+  int blocksNeeded = (size / DISK_BLOCK_SIZE) + (((size % DISK_BLOCK_SIZE) > 0) ? 1 : 0);
+  int blocksFree = 0;
+  bool slotFree = false;
+  for (int b = 0; b < DISK_BLOCK_COUNT; b++)
+    if (!(self->hdr->blockMap[b / 8] & (0x80 >> (b % 8))))
+      blocksFree++;
+
+  // an existing file gives its slot and blocks back when it is rewritten
+  for (int i = 0; i < arraylen(self->hdr->fileTable); i++)
+  {
+    struct _file *file = &self->hdr->fileTable[i];
+    if (file->name[0] == '\0')
+      slotFree = true;
+    else if (strncmp(file->name, fileName, sizeof(file->name)) == 0)
+    {
+      slotFree = true;
+      blocksFree += file->blockCount;
+    }
+  }
+  return slotFree && blocksNeeded <= blocksFree && blocksNeeded <= DISK_FILE_MAX_BLOCKS;
+}
+
+static void diskMount_Write(DiskMount *self, const byte *fileName, const byte *data, dword size, dword modified)
+{
+  assert(self && !self->isReadOnly);
 
   struct _file *targetSlot = NULL;
   struct _file *existingSlot = NULL;
-  for (int i = 0; i < arraylen(self->hdr.fileTable); i++)
+  for (int i = 0; i < arraylen(self->hdr->fileTable); i++)
   {
-    if (!targetSlot && self->hdr.fileTable[i].name[0] == '\0') 
+    if (!targetSlot && self->hdr->fileTable[i].name[0] == '\0')
     {
-      targetSlot = &self->hdr.fileTable[i];
+      targetSlot = &self->hdr->fileTable[i];
     }
-    if (strncmp(self->hdr.fileTable[i].name, fileName, sizeof(self->hdr.fileTable[i].name)) == 0) 
+    if (strncmp(self->hdr->fileTable[i].name, fileName, sizeof(self->hdr->fileTable[i].name)) == 0)
     {
-      existingSlot = &self->hdr.fileTable[i];
+      existingSlot = &self->hdr->fileTable[i];
     }
   }
 
+  struct _file previous;
+  memset(&previous, 0, sizeof(previous));
   if (existingSlot)
   {
-    for (byte b = 0; b < existingSlot->blockCount; b++) 
+    memcpy(&previous, existingSlot, sizeof(previous));
+    for (byte b = 0; b < existingSlot->blockCount; b++)
     {
       byte block = existingSlot->blocks[b];
       byte sector = block / 8;
       byte blockInSector = block % 8;
       byte mask = 0x80 >> blockInSector;
-      self->hdr.blockMap[sector] ^= mask;
+      self->hdr->blockMap[sector] ^= mask;
     }
     memset(existingSlot, 0, sizeof(struct _file));
     targetSlot = existingSlot;
@@ -655,11 +1806,14 @@ static void diskDevice_Write(DiskDevice *self, System *sys)
   int blocksNeeded = (size / DISK_BLOCK_SIZE) + (((size % DISK_BLOCK_SIZE) > 0) ? 1 : 0);
   targetSlot->size = size;
   targetSlot->blockCount = blocksNeeded;
+  targetSlot->plays = previous.plays;
+  targetSlot->played = previous.played;
+  targetSlot->modified = modified;
   for (byte b = 0; b < DISK_BLOCK_COUNT && blocksNeeded > 0; b++) {
     byte sector = b / 8;
     byte blockInSector = b % 8;
     byte mask = 0x80 >> blockInSector;
-    if (!(self->hdr.blockMap[sector] & mask)) {
+    if (!(self->hdr->blockMap[sector] & mask)) {
       blocksNeeded--;
       targetSlot->blocks[blocksNeeded] = b;
     }
@@ -675,10 +1829,10 @@ static void diskDevice_Write(DiskDevice *self, System *sys)
     byte sector = targetSlot->blocks[b] / 8;
     byte blockInSector = targetSlot->blocks[b] % 8;
     byte mask = 0x80 >> blockInSector;
-    self->hdr.blockMap[sector] |= mask;
+    self->hdr->blockMap[sector] |= mask;
 
     // copy data to block
-    byte *blockData = self->blocks[targetSlot->blocks[b]];
+    byte *blockData = diskMount_WriteBlock(self, targetSlot->blocks[b]);
     memset(blockData, 0, DISK_BLOCK_SIZE);
     memcpy(blockData, dataPtr, min(DISK_BLOCK_SIZE, dataRemaining));
 
@@ -688,29 +1842,17 @@ static void diskDevice_Write(DiskDevice *self, System *sys)
   }
   assert(dataRemaining <= 0);
 
-  FILE *fp = fopen(DISK_FILE_NAME, "wb");
-  assert(fp != NULL);
-  for (int b = 0; b < sizeof(DiskDevice); b++)
-    fputc(self->raw[b], fp);
-  fclose(fp);
+  if (!self->isOverlay)
+    diskImage_Save(self->image, self->fileName);
 }
 
-static void diskDevice_Read(DiskDevice *self, System *sys)
+static void diskMount_Read(DiskMount *self, const struct _file *fp, byte *buffer)
 {
-  const byte *fileName = sys->mem.disk.name;
-  struct _file *fp = NULL;
-  memset(sys->mem.disk.buffer, 0, sizeof(sys->mem.disk.buffer));
-  for (int i = 0; i < arraylen(self->hdr.fileTable) && fp == NULL; i++)
-    if (strncmp(self->hdr.fileTable[i].name, fileName,
-      min(sizeof(self->hdr.fileTable[i].name), sizeof(sys->mem.disk.name))) == 0)
-      fp = &self->hdr.fileTable[i];
-  assert(fp);
-
-  byte *bufferPtr = sys->mem.disk.buffer;
+  byte *bufferPtr = buffer;
   dword bytesToRead = fp->size;
-  for (byte b = 0; b < fp->blockCount; b++) 
+  for (byte b = 0; b < fp->blockCount; b++)
   {
-    const byte *blockData = self->blocks[fp->blocks[b]];
+    const byte *blockData = diskMount_ReadBlock(self, fp->blocks[b]);
     memcpy(bufferPtr, blockData, min(bytesToRead, DISK_BLOCK_SIZE));
     bufferPtr += min(bytesToRead, DISK_BLOCK_SIZE);
     bytesToRead -= min(bytesToRead, DISK_BLOCK_SIZE);
@@ -718,19 +1860,422 @@ static void diskDevice_Read(DiskDevice *self, System *sys)
   assert((sdword)bytesToRead <= 0);
 }
 
+static void diskDevice_Initialize(DiskDevice *self)
+{
+  memset(self, 0, sizeof(DiskDevice));
+  self->dirDirty = true;
+}
+
+static void diskDevice_Mount(DiskDevice *self, const char *fileName, bool readOnly, bool overlay)
+{
+  assert(self && fileName);
+  assert(self->mountCount < DISK_MAX_MOUNTS);
+  if (diskMount_Initialize(&self->mounts[self->mountCount], fileName, readOnly, overlay))
+  {
+    self->mountCount++;
+    self->dirDirty = true;
+  }
+}
+
+static void diskDevice_MergeOverlays(DiskDevice *self)
+{
+  for (byte m = 0; m < self->mountCount; m++)
+    diskMount_MergeOverlay(&self->mounts[m]);
+}
+
+static void diskDevice_Dispose(DiskDevice *self)
+{
+  for (byte m = 0; m < self->mountCount; m++)
+    diskMount_Dispose(&self->mounts[m]);
+  memset(self, 0, sizeof(DiskDevice));
+}
+
+static int diskDevice_CompareDirEntries(const void *a, const void *b)
+{
+  const struct _dirEntry *ea = (const struct _dirEntry *)a;
+  const struct _dirEntry *eb = (const struct _dirEntry *)b;
+  int cmp = strncmp(ea->file->name, eb->file->name, sizeof(ea->file->name));
+  return cmp != 0 ? cmp : (int)ea->rank - (int)eb->rank;
+}
+
+static void diskDevice_RefreshDir(DiskDevice *self)
+{
+  if (!self->dirDirty)
+    return;
+
+  // writable mounts shadow read-only ones, then command line order decides
+  self->dirCount = 0;
+  for (byte m = 0; m < self->mountCount; m++)
+  {
+    DiskMount *mount = &self->mounts[m];
+    for (int i = 0; i < arraylen(mount->hdr->fileTable); i++)
+      if (mount->hdr->fileTable[i].name[0] != '\0')
+      {
+        struct _dirEntry *entry = &self->dir[self->dirCount];
+        entry->file = &mount->hdr->fileTable[i];
+        entry->mount = m;
+        entry->rank = m + (mount->isReadOnly ? DISK_MAX_MOUNTS : 0);
+        self->dirCount++;
+      }
+  }
+
+  qsort(self->dir, self->dirCount, sizeof(self->dir[0]), diskDevice_CompareDirEntries);
+
+  word unique = 0;
+  for (word i = 0; i < self->dirCount; i++)
+  {
+    if (unique > 0 && strncmp(self->dir[unique - 1].file->name, self->dir[i].file->name,
+      sizeof(self->dir[i].file->name)) == 0)
+      continue;
+    self->dir[unique] = self->dir[i];
+    unique++;
+  }
+  self->dirCount = unique;
+  self->dirDirty = false;
+}
+
+static struct _dirEntry *diskDevice_Find(DiskDevice *self, const byte *fileName)
+{
+  diskDevice_RefreshDir(self);
+  int lo = 0;
+  int hi = (int)self->dirCount - 1;
+  while (lo <= hi)
+  {
+    int mid = (lo + hi) / 2;
+    int cmp = strncmp(self->dir[mid].file->name, fileName, DISK_FILE_NAME_SIZE);
+    if (cmp == 0) return &self->dir[mid];
+    if (cmp < 0) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return NULL;
+}
+
+// SipHash-2-4, a tag that cannot be made for new contents without the key
+static Uint64 _sipRotate(Uint64 x, int b)
+{
+  return (x << b) | (x >> (64 - b));
+}
+
+static void _sipRound(Uint64 *v)
+{
+  v[0] += v[1]; v[1] = _sipRotate(v[1], 13); v[1] ^= v[0]; v[0] = _sipRotate(v[0], 32);
+  v[2] += v[3]; v[3] = _sipRotate(v[3], 16); v[3] ^= v[2];
+  v[0] += v[3]; v[3] = _sipRotate(v[3], 21); v[3] ^= v[0];
+  v[2] += v[1]; v[1] = _sipRotate(v[1], 17); v[1] ^= v[2]; v[2] = _sipRotate(v[2], 32);
+}
+
+static Uint64 _sipWord(const byte *data, size_t size)
+{
+  Uint64 word = 0;
+  for (size_t b = 0; b < size; b++)
+    word |= (Uint64)data[b] << (b * 8);
+  return word;
+}
+
+static Uint64 _sipHash(const byte *key, const byte *data, size_t size)
+{
+  Uint64 k0 = _sipWord(key, 8);
+  Uint64 k1 = _sipWord(key + 8, 8);
+  Uint64 v[4] = {
+    k0 ^ 0x736f6d6570736575ULL, k1 ^ 0x646f72616e646f6dULL,
+    k0 ^ 0x6c7967656e657261ULL, k1 ^ 0x7465646279746573ULL
+  };
+  size_t full = size - size % 8;
+  for (size_t b = 0; b <= full; b += 8)
+  {
+    Uint64 m = b < full ? _sipWord(data + b, 8) : _sipWord(data + b, size % 8) | (Uint64)size << 56;
+    v[3] ^= m;
+    _sipRound(v);
+    _sipRound(v);
+    v[0] ^= m;
+  }
+  v[2] ^= 0xff;
+  for (int r = 0; r < 4; r++)
+    _sipRound(v);
+  return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+// the key never leaves the host, so a cache file on an image is only
+// trusted when this install wrote it. Without a key there is no cache.
+static bool diskDevice_LoadCacheKey(DiskDevice *self)
+{
+  if (self->cacheKeyed)
+    return true;
+
+  FILE *fp = fopen(DISK_CACHE_KEY_FILE, "rb");
+  if (fp)
+  {
+    self->cacheKeyed = fread(self->cacheKey, 1, sizeof(self->cacheKey), fp) == sizeof(self->cacheKey);
+    fclose(fp);
+    if (self->cacheKeyed)
+      return true;
+  }
+
+  bool generated = true;
+#ifdef _WIN32
+  for (int w = 0; w < DISK_CACHE_KEY_SIZE / 4 && generated; w++)
+  {
+    unsigned int r;
+    generated = rand_s(&r) == 0;
+    memcpy(self->cacheKey + w * 4, &r, 4);
+  }
+#else
+  FILE *rnd = fopen("/dev/urandom", "rb");
+  generated = rnd && fread(self->cacheKey, 1, sizeof(self->cacheKey), rnd) == sizeof(self->cacheKey);
+  if (rnd)
+    fclose(rnd);
+#endif
+  fp = generated ? fopen(DISK_CACHE_KEY_FILE, "wb") : NULL;
+  if (fp)
+  {
+    self->cacheKeyed = fwrite(self->cacheKey, 1, sizeof(self->cacheKey), fp) == sizeof(self->cacheKey);
+    fclose(fp);
+  }
+  if (!self->cacheKeyed)
+    printf("[FC-85] no cache key in %s, nothing is cached\n", DISK_CACHE_KEY_FILE);
+  return self->cacheKeyed;
+}
+
+// cache files live on the first writable image only, library images and
+// other disks are never read for them
+static DiskMount *diskDevice_CacheMount(DiskDevice *self)
+{
+  for (byte m = 0; m < self->mountCount; m++)
+    if (!self->mounts[m].isReadOnly)
+      return &self->mounts[m];
+  return NULL;
+}
+
+static struct _file *diskMount_Find(DiskMount *self, const byte *fileName)
+{
+  for (int i = 0; i < arraylen(self->hdr->fileTable); i++)
+    if (self->hdr->fileTable[i].name[0] != '\0' &&
+      strncmp(self->hdr->fileTable[i].name, fileName, sizeof(self->hdr->fileTable[i].name)) == 0)
+      return &self->hdr->fileTable[i];
+  return NULL;
+}
+
+static void diskMount_Delete(DiskMount *self, struct _file *file)
+{
+  for (byte b = 0; b < file->blockCount; b++)
+  {
+    byte mask = 0x80 >> (file->blocks[b] % 8);
+    self->hdr->blockMap[file->blocks[b] / 8] &= (byte)~mask;
+  }
+  memset(file, 0, sizeof(struct _file));
+  if (!self->isOverlay)
+    diskImage_Save(self->image, self->fileName);
+}
+
+// blocks held by cache files other than the one named
+static int diskMount_CacheBlocks(DiskMount *self, const byte *keep)
+{
+  int blocks = 0;
+  for (int i = 0; i < arraylen(self->hdr->fileTable); i++)
+  {
+    struct _file *file = &self->hdr->fileTable[i];
+    if (file->name[0] == DISK_CACHE_PREFIX && strncmp(file->name, keep, sizeof(file->name)) != 0)
+      blocks += file->blockCount;
+  }
+  return blocks;
+}
+
+// drops the oldest cache file other than the one named, false when there
+// is none left to drop
+static bool diskMount_EvictCache(DiskMount *self, const byte *keep)
+{
+  struct _file *oldest = NULL;
+  for (int i = 0; i < arraylen(self->hdr->fileTable); i++)
+  {
+    struct _file *file = &self->hdr->fileTable[i];
+    if (file->name[0] == DISK_CACHE_PREFIX && strncmp(file->name, keep, sizeof(file->name)) != 0 &&
+      (!oldest || file->modified < oldest->modified))
+      oldest = file;
+  }
+  if (!oldest)
+    return false;
+
+  printf("[FC-85] dropping cached %s\n", oldest->name);
+  diskMount_Delete(self, oldest);
+  return true;
+}
+
+// the contents are followed by their tag, built in the staging buffer.
+// Cache files never hold more than DISK_CACHE_MAX_BLOCKS between them.
+static void diskDevice_WriteCache(DiskDevice *self, System *sys, dword size)
+{
+  const byte *fileName = sys->mem.disk.name;
+  DiskMount *target = diskDevice_CacheMount(self);
+  if (!target || !diskDevice_LoadCacheKey(self) || size + DISK_CACHE_TAG_SIZE > DISK_FILE_SIZE_MAX)
+    return;
+
+  Uint64 tag = _sipHash(self->cacheKey, sys->mem.disk.buffer, size);
+  memcpy(self->staging.data, sys->mem.disk.buffer, size);
+  memcpy(self->staging.data + size, &tag, DISK_CACHE_TAG_SIZE);
+  self->staging.valid = false;
+
+  size += DISK_CACHE_TAG_SIZE;
+  int blocksNeeded = (size + DISK_BLOCK_SIZE - 1) / DISK_BLOCK_SIZE;
+  bool fits = false;
+  do
+  {
+    fits = diskMount_CacheBlocks(target, fileName) + blocksNeeded <= DISK_CACHE_MAX_BLOCKS &&
+      diskMount_Fits(target, fileName, size);
+  } while (!fits && diskMount_EvictCache(target, fileName));
+  self->dirDirty = true;
+  if (!fits)
+  {
+    printf("[FC-85] no room to cache %s\n", fileName);
+    return;
+  }
+
+  diskMount_Write(target, fileName, self->staging.data, size, sys->mem.sys.clock);
+  self->dirDirty = true;
+}
+
+// a cache file that is missing, or was not written with this install's
+// key, reads as an empty buffer
+static void diskDevice_ReadCache(DiskDevice *self, System *sys)
+{
+  DiskMount *mount = diskDevice_CacheMount(self);
+  struct _file *file = mount ? diskMount_Find(mount, sys->mem.disk.name) : NULL;
+  if (!file || file->size < DISK_CACHE_TAG_SIZE || !diskDevice_LoadCacheKey(self))
+    return;
+
+  dword size = file->size - DISK_CACHE_TAG_SIZE;
+  Uint64 tag;
+  self->staging.valid = false;
+  diskMount_Read(mount, file, self->staging.data);
+  memcpy(&tag, self->staging.data + size, DISK_CACHE_TAG_SIZE);
+  if (tag != _sipHash(self->cacheKey, self->staging.data, size))
+  {
+    printf("[FC-85] %s was not written by this console, ignored\n", file->name);
+    return;
+  }
+  memcpy(sys->mem.disk.buffer, self->staging.data, size);
+}
+
+static void diskDevice_Write(DiskDevice *self, System *sys)
+{
+  assert(self && sys);
+  const byte *fileName = sys->mem.disk.name;
+  const dword size = (dword)min(sizeof(sys->mem.disk.buffer),
+    sys->mem.disk.size ? sys->mem.disk.size : strlen(sys->mem.disk.buffer));
+  const byte *data = sys->mem.disk.buffer;
+
+  if (fileName[0] == DISK_CACHE_PREFIX)
+  {
+    diskDevice_WriteCache(self, sys, size);
+    return;
+  }
+
+  // files are written back to the image that owns them, new files and
+  // files owned by a read-only image go to the first writable image
+  DiskMount *target = NULL;
+  struct _dirEntry *entry = diskDevice_Find(self, fileName);
+  if (entry && !self->mounts[entry->mount].isReadOnly)
+    target = &self->mounts[entry->mount];
+  for (byte m = 0; m < self->mountCount && !target; m++)
+    if (!self->mounts[m].isReadOnly)
+      target = &self->mounts[m];
+
+  if (!target)
+  {
+    printf("[FC-85] no writable disk mounted, %s not written\n", fileName);
+    return;
+  }
+
+  // cache files make way for the user's own
+  while (!diskMount_Fits(target, fileName, size) && diskMount_EvictCache(target, ""))
+    self->dirDirty = true;
+  if (!diskMount_Fits(target, fileName, size))
+  {
+    printf("[FC-85] disk full, %s not written\n", fileName);
+    return;
+  }
+
+  diskMount_Write(target, fileName, data, size, sys->mem.sys.clock);
+  self->dirDirty = true;
+  self->staging.valid = false;
+}
+
+static void diskDevice_Prefetch(DiskDevice *self, System *sys)
+{
+  const byte *fileName = sys->mem.disk.name;
+  if (fileName[0] == DISK_CACHE_PREFIX)
+    return;
+  if (self->staging.valid && 
+    strncmp(self->staging.name, fileName, sizeof(self->staging.name)) == 0)
+    return;
+
+  struct _dirEntry *entry = diskDevice_Find(self, fileName);
+  self->staging.valid = false;
+  if (!entry)
+    return;
+
+  memset(self->staging.data, 0, sizeof(self->staging.data));
+  diskMount_Read(&self->mounts[entry->mount], entry->file, self->staging.data);
+  memcpy(self->staging.name, entry->file->name, sizeof(self->staging.name));
+  self->staging.size = entry->file->size;
+  self->staging.valid = true;
+}
+
+static void diskDevice_Read(DiskDevice *self, System *sys)
+{
+  const byte *fileName = sys->mem.disk.name;
+  memset(sys->mem.disk.buffer, 0, sizeof(sys->mem.disk.buffer));
+  if (fileName[0] == DISK_CACHE_PREFIX)
+  {
+    diskDevice_ReadCache(self, sys);
+    return;
+  }
+
+  // a prefetched file is served from the staging buffer without block reads
+  if (self->staging.valid &&
+    strncmp(self->staging.name, fileName, sizeof(self->staging.name)) == 0)
+  {
+    memcpy(sys->mem.disk.buffer, self->staging.data,
+      min(self->staging.size, sizeof(sys->mem.disk.buffer)));
+    return;
+  }
+
+  // a missing file reads as an empty buffer
+  struct _dirEntry *entry = diskDevice_Find(self, fileName);
+  if (!entry)
+    return;
+  diskMount_Read(&self->mounts[entry->mount], entry->file, sys->mem.disk.buffer);
+}
+
+static void diskDevice_Play(DiskDevice *self, System *sys)
+{
+  struct _dirEntry *entry = diskDevice_Find(self, sys->mem.disk.name);
+  if (!entry)
+    return;
+
+  // library images only keep the play record for this session
+  DiskMount *mount = &self->mounts[entry->mount];
+  entry->file->plays++;
+  entry->file->played = sys->mem.sys.clock;
+  if (!mount->isReadOnly && !mount->isOverlay)
+    diskImage_SaveHeader(mount->hdr, mount->fileName);
+}
+
 static void diskDevice_Dir(DiskDevice *self, System *sys)
 {
-  byte dirCnt = 0;
-  struct _file *dir[arraylen(self->hdr.fileTable) + 1];
-  memset(dir, 0, sizeof(dir));
-  for (int i = 0; i < arraylen(self->hdr.fileTable); i++)
-    if (self->hdr.fileTable[i].name[0] != '\0')
-    {
-      dir[dirCnt] = &self->hdr.fileTable[i];
-      dirCnt++;
-    }
-  memcpy(sys->mem.disk.buffer, dir, 
-    min(sizeof(dir), sizeof(sys->mem.disk.buffer)));
+  diskDevice_RefreshDir(self);
+  // records are copied by value, host pointers in system memory would make
+  // it differ from run to run
+  struct _file *dir = (struct _file *)sys->mem.disk.buffer;
+  word maxEntries = (word)(sizeof(sys->mem.disk.buffer) / sizeof(struct _file)) - 1;
+  word dirCnt = 0;
+  for (word i = 0; i < self->dirCount && dirCnt < maxEntries; i++)
+  {
+    if (self->dir[i].file->name[0] == DISK_CACHE_PREFIX)
+      continue;
+    memcpy(&dir[dirCnt], self->dir[i].file, sizeof(struct _file));
+    dirCnt++;
+  }
+  memset(&dir[dirCnt], 0, sizeof(struct _file));
 }
 
 static void diskDevice_Interrupt(DiskDevice *self, System *sys)
@@ -738,17 +2283,386 @@ static void diskDevice_Interrupt(DiskDevice *self, System *sys)
   if (sys->mem.disk.code == DISK_CODE_WRITE) diskDevice_Write(self, sys);
   else if (sys->mem.disk.code == DISK_CODE_READ) diskDevice_Read(self, sys);
   else if (sys->mem.disk.code == DISK_CODE_DIR) diskDevice_Dir(self, sys);
+  else if (sys->mem.disk.code == DISK_CODE_PLAY) diskDevice_Play(self, sys);
+  else if (sys->mem.disk.code == DISK_CODE_PREFETCH) diskDevice_Prefetch(self, sys);
   sys->mem.disk.code = DISK_CODE_NONE;
+  sys->mem.disk.size = 0;
 }
 
 /* ------------------------------------------------------------------------- */
 // InputDevice
 /* ------------------------------------------------------------------------- */
 
+// one entry per line: frame, button mask (decimal or 0x hex), optional text
+static void inputDevice_LoadScript(InputDevice *self, const char *fileName)
+{
+  char line[256];
+  dword capacity = 64;
+  FILE *fp = fopen(fileName, "r");
+  assert(fp != NULL);
+  self->script = (InputScriptEntry *)calloc(capacity, sizeof(InputScriptEntry));
+  assert(self->script);
+  while (fgets(line, sizeof(line), fp))
+  {
+    unsigned int frame = 0;
+    unsigned int btns = 0;
+    char text[INPT_SCRIPT_TEXT_SIZE] = {'\0'};
+    if (line[0] == '#' || sscanf(line, "%u %i %15[^\r\n]", &frame, &btns, text) < 2)
+      continue;
+
+    if (self->scriptCount == capacity)
+    {
+      capacity *= 2;
+      self->script = (InputScriptEntry *)realloc(self->script, capacity * sizeof(InputScriptEntry));
+      assert(self->script);
+    }
+    InputScriptEntry *entry = &self->script[self->scriptCount];
+    self->scriptCount++;
+    memset(entry, 0, sizeof(InputScriptEntry));
+    entry->frame = frame;
+    entry->btns = (word)btns;
+    memcpy(entry->text, text, sizeof(entry->text));
+  }
+  fclose(fp);
+  printf("[FC-85] loaded %u input script entries from %s\n", self->scriptCount, fileName);
+}
+
+// host time an SDL event arrived, SDL timestamps are milliseconds
+static Uint64 inputDevice_EventArrival(InputDevice *self, dword timestamp)
+{
+  Sint64 ms = (Sint64)timestamp - (Sint64)self->ticksBase;
+  return self->counterBase + ms * (Sint64)SDL_GetPerformanceFrequency() / 1000;
+}
+
+static void inputDevice_PushEvent(InputDevice *self, System *sys, word btn, byte flags, dword time, Uint64 arrival)
+{
+  struct _inpt *inpt = &sys->mem.inpt;
+  if ((byte)(inpt->head - inpt->tail) >= INPT_EVENT_RING_SIZE)
+  {
+    inpt->dropped += inpt->dropped < 0xFF ? 1 : 0;
+    return;
+  }
+
+  struct _inptEvent *event = _inptEvent(sys, inpt->head);
+  event->time = time;
+  event->btn = btn;
+  event->flags = flags;
+  self->arrivals[inpt->head & (INPT_EVENT_RING_SIZE - 1)] = arrival;
+  inpt->head++;
+}
+
+// every press pushed this frame is now on screen
+static void inputDevice_Presented(InputDevice *self, System *sys, Uint64 presented)
+{
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  for (byte e = self->frameHead; e != sys->mem.inpt.head; e++)
+  {
+    Uint64 arrival = self->arrivals[e & (INPT_EVENT_RING_SIZE - 1)];
+    if (!(_inptEvent(sys, e)->flags & INPT_EVENT_PRESS))
+      continue;
+    histogram_Add(&self->latency,
+      presented > arrival ? (dword)((presented - arrival) * 1000000 / frequency) : 0);
+  }
+}
+
+static void inputDevice_ReportLatency(InputDevice *self)
+{
+  if (self->latency.samples == 0)
+    return;
+  printf("[FC-85] input to present: %u presses, p50:%uus, p95:%uus, p99:%uus, max:%uus\n",
+    self->latency.samples,
+    histogram_Percentile(&self->latency, false, 50),
+    histogram_Percentile(&self->latency, false, 95),
+    histogram_Percentile(&self->latency, false, 99),
+    self->latency.max);
+}
+
+static void inputDevice_WriteDword(FILE *fp, dword value)
+{
+  for (byte b = 0; b < 4; b++)
+    fputc((value >> (b * 8)) & 0xFF, fp);
+}
+
+static dword inputDevice_ReadDword(InputDevice *self)
+{
+  dword value = 0;
+  for (byte b = 0; b < 4 && self->replayNext < self->replaySize; b++)
+    value |= (dword)self->replay[self->replayNext++] << (b * 8);
+  return value;
+}
+
+// frames are stored relative to the one before: a flags byte followed by
+// only the fields that changed, and runs of identical frames as one byte
+static void inputDevice_StartRecording(InputDevice *self, const char *fileName)
+{
+  self->record = fopen(fileName, "wb");
+  assert(self->record != NULL);
+  inputDevice_WriteDword(self->record, INPT_RECORD_MAGIC);
+  memset(&self->last, 0, sizeof(self->last));
+  self->recordRun = 0;
+}
+
+static void inputDevice_FlushRun(InputDevice *self)
+{
+  if (self->recordRun == 0)
+    return;
+  fputc(INPT_RECORD_RUN | self->recordRun, self->record);
+  self->recordRun = 0;
+}
+
+static void inputDevice_Record(InputDevice *self, System *sys)
+{
+  if (!self->record)
+    return;
+
+  struct _inpt *inpt = &sys->mem.inpt;
+  byte textLen = (byte)strlen(inpt->text);
+  dword delta;
+  memcpy(&delta, &sys->mem.sys.delta, sizeof(delta));
+  byte flags = 0;
+  flags |= inpt->btns != self->last.btns ? INPT_RECORD_BTNS : 0;
+  flags |= textLen > 0 ? INPT_RECORD_TEXT : 0;
+  flags |= memcmp(&sys->mem.sys.delta, &self->last.delta, sizeof(float)) ? INPT_RECORD_DELTA : 0;
+  flags |= sys->mem.sys.clock != self->last.clock ? INPT_RECORD_CLOCK : 0;
+  flags |= inpt->head != inpt->tail ? INPT_RECORD_EVENTS : 0;
+
+  if (flags == 0)
+  {
+    self->recordRun++;
+    if (self->recordRun == INPT_RECORD_MAX_RUN)
+      inputDevice_FlushRun(self);
+    return;
+  }
+
+  inputDevice_FlushRun(self);
+  fputc(flags, self->record);
+  if (flags & INPT_RECORD_BTNS)
+  {
+    fputc(inpt->btns & 0xFF, self->record);
+    fputc(inpt->btns >> 8, self->record);
+  }
+  if (flags & INPT_RECORD_TEXT)
+  {
+    fputc(textLen, self->record);
+    fwrite(inpt->text, 1, textLen, self->record);
+  }
+  if (flags & INPT_RECORD_DELTA)
+    inputDevice_WriteDword(self->record, delta);
+  if (flags & INPT_RECORD_CLOCK)
+    inputDevice_WriteDword(self->record, sys->mem.sys.clock);
+  if (flags & INPT_RECORD_EVENTS)
+  {
+    fputc((byte)(inpt->head - inpt->tail), self->record);
+    for (byte e = inpt->tail; e != inpt->head; e++)
+    {
+      struct _inptEvent *event = _inptEvent(sys, e);
+      inputDevice_WriteDword(self->record, event->time);
+      fputc(event->btn & 0xFF, self->record);
+      fputc(event->btn >> 8, self->record);
+      fputc(event->flags, self->record);
+    }
+  }
+
+  self->last.btns = inpt->btns;
+  self->last.delta = sys->mem.sys.delta;
+  self->last.clock = sys->mem.sys.clock;
+}
+
+static void inputDevice_LoadReplay(InputDevice *self, const char *fileName)
+{
+  FILE *fp = fopen(fileName, "rb");
+  assert(fp != NULL);
+  fseek(fp, 0, SEEK_END);
+  self->replaySize = (dword)ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  self->replay = (byte *)malloc(self->replaySize + 1);
+  assert(self->replay);
+  self->replaySize = (dword)fread(self->replay, 1, self->replaySize, fp);
+  fclose(fp);
+
+  self->replayNext = 0;
+  self->replayRun = 0;
+  memset(&self->last, 0, sizeof(self->last));
+  assert(inputDevice_ReadDword(self) == INPT_RECORD_MAGIC);
+  printf("[FC-85] replaying %u bytes of input from %s\n", self->replaySize, fileName);
+}
+
+// whether the frame record after a flags byte lies wholly in the
+// recording, its counts are checked before anything is read by them
+static bool inputDevice_RecordFits(InputDevice *self, byte flags, byte textSize)
+{
+  const byte *replay = self->replay;
+  dword pos = self->replayNext;
+  dword size = self->replaySize;
+  if (flags & INPT_RECORD_BTNS)
+    pos += 2;
+  if (flags & INPT_RECORD_TEXT)
+  {
+    if (pos >= size || replay[pos] >= textSize)
+      return false;
+    pos += 1 + replay[pos];
+  }
+  if (flags & INPT_RECORD_DELTA)
+    pos += 4;
+  if (flags & INPT_RECORD_CLOCK)
+    pos += 4;
+  if (flags & INPT_RECORD_EVENTS)
+  {
+    if (pos >= size)
+      return false;
+    pos += 1 + replay[pos] * 7;
+  }
+  return pos <= size;
+}
+
+static void inputDevice_Replay(InputDevice *self, System *sys)
+{
+  struct _inpt *inpt = &sys->mem.inpt;
+  if (self->replayRun == 0)
+  {
+    // the power button is pressed once the session has been played out
+    if (self->replayNext >= self->replaySize)
+    {
+      inpt->btns |= INPT_BTN_POWR;
+      return;
+    }
+
+    byte flags = self->replay[self->replayNext++];
+    // a truncated or corrupt record ends the session like its end would
+    if (!(flags & INPT_RECORD_RUN) && !inputDevice_RecordFits(self, flags, sizeof(inpt->text)))
+    {
+      printf("[FC-85] replay ends in a broken record at byte %u\n", self->replayNext - 1);
+      self->replayNext = self->replaySize;
+      inpt->btns |= INPT_BTN_POWR;
+      return;
+    }
+
+    if (flags & INPT_RECORD_RUN)
+    {
+      self->replayRun = flags & INPT_RECORD_MAX_RUN;
+    }
+    else
+    {
+      if (flags & INPT_RECORD_BTNS)
+      {
+        self->last.btns = self->replay[self->replayNext];
+        self->last.btns |= (word)self->replay[self->replayNext + 1] << 8;
+        self->replayNext += 2;
+      }
+      if (flags & INPT_RECORD_TEXT)
+      {
+        byte textLen = self->replay[self->replayNext++];
+        memcpy(inpt->text, &self->replay[self->replayNext], textLen);
+        self->replayNext += textLen;
+      }
+      if (flags & INPT_RECORD_DELTA)
+      {
+        dword delta = inputDevice_ReadDword(self);
+        memcpy(&self->last.delta, &delta, sizeof(float));
+      }
+      if (flags & INPT_RECORD_CLOCK)
+        self->last.clock = inputDevice_ReadDword(self);
+      if (flags & INPT_RECORD_EVENTS)
+      {
+        byte count = self->replay[self->replayNext++];
+        for (byte e = 0; e < count; e++)
+        {
+          dword time = inputDevice_ReadDword(self);
+          word btn = self->replay[self->replayNext];
+          btn |= (word)self->replay[self->replayNext + 1] << 8;
+          inputDevice_PushEvent(self, sys, btn, self->replay[self->replayNext + 2], time,
+            SDL_GetPerformanceCounter());
+          self->replayNext += 3;
+        }
+      }
+      self->replayRun = 1;
+    }
+  }
+
+  self->replayRun--;
+  inpt->btns = self->last.btns;
+  sys->mem.sys.delta = self->last.delta;
+  sys->mem.sys.clock = self->last.clock;
+}
+
+static void inputDevice_Dispose(InputDevice *self)
+{
+  if (self->record)
+  {
+    inputDevice_FlushRun(self);
+    fclose(self->record);
+  }
+  free(self->replay);
+  free(self->script);
+  memset(self, 0, sizeof(InputDevice));
+}
+
+static void inputDevice_Script(InputDevice *self, System *sys)
+{
+  // the power button is pressed once the script has been played out
+  if (self->scriptNext == self->scriptCount)
+  {
+    sys->mem.inpt.btns |= INPT_BTN_POWR;
+    return;
+  }
+
+  while (self->scriptNext < self->scriptCount &&
+    self->script[self->scriptNext].frame <= self->frame)
+  {
+    InputScriptEntry *entry = &self->script[self->scriptNext];
+    self->scriptNext++;
+    sys->mem.inpt.btns |= entry->btns;
+    for (byte b = 0; b < 16; b++)
+      if (entry->btns & (1 << b))
+        inputDevice_PushEvent(self, sys, (word)(1 << b), INPT_EVENT_PRESS, self->frame * 50 / 3,
+          SDL_GetPerformanceCounter());
+    strncat(sys->mem.inpt.text, entry->text,
+      sizeof(sys->mem.inpt.text) - strlen(sys->mem.inpt.text) - 1);
+  }
+}
+
+static word inputDevice_MapKey(SDL_Keycode key)
+{
+  switch (key)
+  {
+    case SDLK_ESCAPE:     return INPT_BTN_ESCP;
+    case SDLK_UP:         return INPT_BTN_UP;
+    case SDLK_DOWN:       return INPT_BTN_DOWN;
+    case SDLK_LEFT:       return INPT_BTN_LEFT;
+    case SDLK_RIGHT:      return INPT_BTN_RIGHT;
+    case SDLK_z:          return INPT_BTN_A;
+    case SDLK_x:          return INPT_BTN_B;
+    case SDLK_BACKSPACE:  return INPT_BTN_BKSP;
+    case SDLK_RETURN:     return INPT_BTN_RETN | INPT_BTN_A;
+  }
+  return 0;
+}
+
 static void inputDevice_Interrupt(InputDevice *self, System *sys) 
 {
-  static SDL_Event event;
-  memset(&sys->mem.inpt, 0, sizeof(sys->mem.inpt));
+  SDL_Event event;
+  // the event ring carries over, only the per-frame state is cleared
+  sys->mem.inpt.btns = 0;
+  memset(sys->mem.inpt.text, 0, sizeof(sys->mem.inpt.text));
+  self->hostKeys = 0;
+  self->frame++;
+  self->frameHead = sys->mem.inpt.head;
+  if (self->counterBase == 0)
+  {
+    self->counterBase = SDL_GetPerformanceCounter();
+    self->ticksBase = SDL_GetTicks();
+  }
+  if (self->replay)
+  {
+    inputDevice_Replay(self, sys);
+    return;
+  }
+  if (self->script)
+  {
+    inputDevice_Script(self, sys);
+    return;
+  }
+
   while (SDL_PollEvent(&event))
   {
       switch(event.type)
@@ -758,8 +2672,17 @@ static void inputDevice_Interrupt(InputDevice *self, System *sys)
           break;
         case SDL_KEYUP:
           if (event.key.keysym.sym == SDLK_ESCAPE) sys->mem.inpt.btns |= INPT_BTN_ESCP;
+          if (event.key.keysym.sym == SDLK_F8) self->rewinding = false;
+          if (inputDevice_MapKey(event.key.keysym.sym))
+            inputDevice_PushEvent(self, sys, inputDevice_MapKey(event.key.keysym.sym),
+              INPT_EVENT_RELEASE, event.key.timestamp,
+              inputDevice_EventArrival(self, event.key.timestamp));
           break;
         case SDL_KEYDOWN:
+          if (inputDevice_MapKey(event.key.keysym.sym))
+            inputDevice_PushEvent(self, sys, inputDevice_MapKey(event.key.keysym.sym),
+              INPT_EVENT_PRESS | (event.key.repeat ? INPT_EVENT_REPEAT : 0), event.key.timestamp,
+              inputDevice_EventArrival(self, event.key.timestamp));
           if (event.key.keysym.sym == SDLK_UP)    sys->mem.inpt.btns |= INPT_BTN_UP;
           if (event.key.keysym.sym == SDLK_DOWN)  sys->mem.inpt.btns |= INPT_BTN_DOWN;
           if (event.key.keysym.sym == SDLK_LEFT)  sys->mem.inpt.btns |= INPT_BTN_LEFT;
@@ -767,6 +2690,14 @@ static void inputDevice_Interrupt(InputDevice *self, System *sys)
           if (event.key.keysym.sym == SDLK_z)     sys->mem.inpt.btns |= INPT_BTN_A;
           if (event.key.keysym.sym == SDLK_x)     sys->mem.inpt.btns |= INPT_BTN_B;
           if (event.key.keysym.sym == SDLK_BACKSPACE) sys->mem.inpt.btns |= INPT_BTN_BKSP;
+#ifdef FC85_PROFILE
+          if (event.key.keysym.sym == SDLK_F3) sys->prof->overlay = !sys->prof->overlay;
+#endif
+          if (event.key.keysym.sym == SDLK_F5)
+            self->hostKeys |= (event.key.keysym.mod & KMOD_SHIFT) ? INPT_HOST_SAVE_FILE : INPT_HOST_SAVE_STATE;
+          if (event.key.keysym.sym == SDLK_F8) self->rewinding = true;
+          if (event.key.keysym.sym == SDLK_F9)
+            self->hostKeys |= (event.key.keysym.mod & KMOD_SHIFT) ? INPT_HOST_LOAD_FILE : INPT_HOST_LOAD_STATE;
           if (event.key.keysym.sym == SDLK_RETURN) {
               sys->mem.inpt.btns |= INPT_BTN_RETN;
               sys->mem.inpt.btns |= INPT_BTN_A;
@@ -783,54 +2714,184 @@ static void inputDevice_Interrupt(InputDevice *self, System *sys)
 // Game Loop
 /* ------------------------------------------------------------------------- */
 
-static void tick() 
+// F5/F9 save and load the in-memory slot, with shift a state file
+static void fc85_HandleHostKeys(FC85 *self)
+{
+  byte keys = self->inpt.hostKeys;
+  Uint64 start = SDL_GetPerformanceCounter();
+  if (keys & INPT_HOST_SAVE_STATE)
+  {
+    if (!self->saveState)
+      self->saveState = saveState_Create();
+    if (!system_SaveState(&self->sys, self->saveState))
+    {
+      printf("[FC-85] no state is saved while a game is playing\n");
+      keys &= (byte)~INPT_HOST_SAVE_STATE;
+    }
+  }
+  if (keys & INPT_HOST_SAVE_FILE)
+    system_Hibernate(&self->sys, SYS_STATE_FILE_NAME);
+  if ((keys & INPT_HOST_LOAD_STATE) && self->saveState)
+    system_LoadState(&self->sys, self->saveState);
+  if (keys & INPT_HOST_LOAD_FILE)
+    system_Wake(&self->sys, SYS_STATE_FILE_NAME);
+  if (keys & (INPT_HOST_LOAD_STATE | INPT_HOST_LOAD_FILE))
+    self->inpt.frameHead = self->sys.mem.inpt.head;
+  if (keys)
+    printf("[FC-85] state %s in %.1fus\n",
+      (keys & (INPT_HOST_SAVE_STATE | INPT_HOST_SAVE_FILE)) ? "saved" : "loaded",
+      (double)(SDL_GetPerformanceCounter() - start) * 1000000.0 / SDL_GetPerformanceFrequency());
+}
+
+static void tick(FC85 *fc85) 
 {
-  static Uint64 oldTime = 0;
-  static Uint64 newTime = 0;
-  FC85 *fc85 = fc85_Get();
+  PROFILE_BEGIN(&fc85->prof, PROFILE_STAGE_FRAME);
+  PROFILE_BEGIN(&fc85->prof, PROFILE_STAGE_INPUT);
   inputDevice_Interrupt(&fc85->inpt, &fc85->sys);
-  newTime = SDL_GetTicks();
-  float delta = (float)(newTime - oldTime) / 1000.0f;
-  oldTime = newTime;
-  fc85->sys.mem.sys.delta = delta;
-  system_Tick(&fc85->sys);
+  PROFILE_END(&fc85->prof, PROFILE_STAGE_INPUT);
+  fc85_HandleHostKeys(fc85);
+  // holding the rewind key steps back a frame each tick in place of running
+  bool rewinding = fc85->rewind && fc85->inpt.rewinding;
+  if (rewinding && rewind_StepBack(fc85->rewind, &fc85->sys))
+    fc85->inpt.frameHead = fc85->sys.mem.inpt.head;
+  Uint64 ticks = SDL_GetTicks();
+  float delta = (float)(ticks - fc85->lastTicks) / 1000.0f;
+  fc85->lastTicks = ticks;
+  // scripted runs advance a fixed step per frame so they replay the same,
+  // a replayed session brings back the recorded delta and clock
+  if (!fc85->inpt.replay && !rewinding)
+  {
+    fc85->sys.mem.sys.delta = fc85->inpt.script ? INPT_HEADLESS_DELTA : delta;
+    fc85->sys.mem.sys.clock = (dword)time(NULL);
+  }
+  if (!rewinding)
+  {
+    inputDevice_Record(&fc85->inpt, &fc85->sys);
+    PROFILE_BEGIN(&fc85->prof, PROFILE_STAGE_SYSTEM);
+    system_Tick(&fc85->sys);
+    PROFILE_END(&fc85->prof, PROFILE_STAGE_SYSTEM);
+  }
+  PROFILE_BEGIN(&fc85->prof, PROFILE_STAGE_DISPLAY);
   displayDevice_Interrupt(&fc85->disp, &fc85->sys);
+  PROFILE_END(&fc85->prof, PROFILE_STAGE_DISPLAY);
+  inputDevice_Presented(&fc85->inpt, &fc85->sys, fc85->disp.presented);
+  PROFILE_BEGIN(&fc85->prof, PROFILE_STAGE_DISK);
   diskDevice_Interrupt(&fc85->disk, &fc85->sys);
+  PROFILE_END(&fc85->prof, PROFILE_STAGE_DISK);
+  if (fc85->rewind && !rewinding)
+    rewind_Capture(fc85->rewind, &fc85->sys);
+  PROFILE_END(&fc85->prof, PROFILE_STAGE_FRAME);
 }
 
 /* ------------------------------------------------------------------------- */
 // Entry Point
 /* ------------------------------------------------------------------------- */
 
+// the batch runner includes this file for the console and brings its own
+#ifndef FC85_BATCH
 int main(int argc, char **argv) 
 {
+  bool overlay = false;
+  bool merge = false;
+  bool hibernate = false;
+  bool rewinder = false;
+  const char *script = NULL;
+  const char *record = NULL;
+  const char *replay = NULL;
+  for (int a = 1; a < argc; a++)
+  {
+    if (strcmp(argv[a], "--headless") == 0 && a + 1 < argc) script = argv[++a];
+    else if (strcmp(argv[a], "--record") == 0 && a + 1 < argc) record = argv[++a];
+    else if (strcmp(argv[a], "--replay") == 0 && a + 1 < argc) replay = argv[++a];
+    else if (strcmp(argv[a], "--overlay") == 0) overlay = true;
+    else if (strcmp(argv[a], "--merge") == 0) overlay = merge = true;
+    else if (strcmp(argv[a], "--hibernate") == 0) hibernate = true;
+    else if (strcmp(argv[a], "--rewind") == 0) rewinder = true;
+  }
+
   printf("[FC-85]  memory: total:%d, sys:%zd, appl:%zd\n", 
     SYS_MEMORY,
     SYS_MEMORY - msizeof(System, mem.appl),
     msizeof(System, mem.appl));
+  processArena_Report();
 
-  FC85 *fc85 = fc85_Get();
+  FC85 *fc85 = fc85_Create();
   printf("[FC-85] initiating boot sequence...\n");
   printf("[FC-85] initializing display device...\n");
-  displayDevice_Initialize(&fc85->disp);
+  displayDevice_Initialize(&fc85->disp, script != NULL || replay != NULL);
   printf("[FC-85] initializing disk device...\n");
   diskDevice_Initialize(&fc85->disk);
+  for (int a = 1; a < argc - 1; a++)
+  {
+    if (strcmp(argv[a], "--disk") == 0) diskDevice_Mount(&fc85->disk, argv[++a], false, overlay);
+    else if (strcmp(argv[a], "--lib") == 0) diskDevice_Mount(&fc85->disk, argv[++a], true, overlay);
+  }
+  if (fc85->disk.mountCount == 0)
+    diskDevice_Mount(&fc85->disk, DISK_FILE_NAME, false, overlay);
   printf("[FC-85] initializing input device...\n");
-  printf("[FC-85] system boot...\n");
-  system_Boot(&fc85->sys);
+  if (replay)
+    inputDevice_LoadReplay(&fc85->inpt, replay);
+  else if (script)
+    inputDevice_LoadScript(&fc85->inpt, script);
+  if (record)
+    inputDevice_StartRecording(&fc85->inpt, record);
+  if (hibernate && system_Wake(&fc85->sys, SYS_SNAPSHOT_FILE_NAME))
+  {
+    printf("[FC-85] system resumed from "SYS_SNAPSHOT_FILE_NAME"\n");
+  }
+  else
+  {
+    printf("[FC-85] system boot...\n");
+    system_Boot(&fc85->sys);
+  }
+  if (rewinder)
+    fc85->rewind = rewind_Create();
   printf("[FC-85] boot sequence complete\n");
 
-  while (!system_IsShutdownFlagSet(&fc85->sys)) tick();
+  dword ticks = 0;
+  Uint64 start = SDL_GetPerformanceCounter();
+  while (!system_IsShutdownFlagSet(&fc85->sys)) 
+  {
+    tick(fc85);
+    ticks++;
+  }
+  if (script || replay)
+  {
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    printf("[FC-85] headless: %u ticks in %.3fs, %.0f ticks/sec\n",
+      ticks, seconds, seconds > 0.0 ? ticks / seconds : 0.0);
+  }
 
   printf("[FC-85] initiating shutdown sequence...\n");
   printf("[FC-85] system shutdown...\n");
+  if (hibernate)
+  {
+    printf("[FC-85] hibernating to "SYS_SNAPSHOT_FILE_NAME"...\n");
+    system_Hibernate(&fc85->sys, SYS_SNAPSHOT_FILE_NAME);
+  }
+  if (fc85->rewind)
+    rewind_Report(fc85->rewind);
+#ifdef FC85_PROFILE
+  printf("[FC-85] writing frame profile to "PROFILE_FILE_NAME"...\n");
+  profiler_Dump(&fc85->prof, PROFILE_FILE_NAME);
+#endif
   printf("[FC-85] disposing input device...\n");
+  inputDevice_ReportLatency(&fc85->inpt);
+  inputDevice_Dispose(&fc85->inpt);
   printf("[FC-85] disposing disk device...\n");
+  if (merge)
+  {
+    printf("[FC-85] merging disk overlays...\n");
+    diskDevice_MergeOverlays(&fc85->disk);
+  }
+  diskDevice_Dispose(&fc85->disk);
   printf("[FC-85] disposing display device...\n");
-  displayDevice_Initialize(&fc85->disp);
+  displayDevice_Dispose(&fc85->disp);
+  fc85_Destroy(fc85);
   printf("[FC-85] shutdown sequence complete\n");
   exit(EXIT_SUCCESS);
 }
+#endif
 
 /* ------------------------------------------------------------------------- */
 // Process Implementations
@@ -843,3 +2904,5 @@ int main(int argc, char **argv)
 #include "proc_create.h"
 #include "proc_edit.h"
 #include "proc_code.h"
+#include "lang.h"
+#include "proc_play.h"
@@ -0,0 +1,275 @@
+// FC-85 - A Fantasy Console developed for #FCDEV_JAM 2017
+// Created by Shawn Rakowski
+//
+// Batch runner, plays many input scripts in headless consoles in parallel.
+// usage: fc85_batch [--threads n] <manifest>
+// each manifest line is an input script and an optional disk, # comments
+
+
+/* ------------------------------------------------------------------------- */
+// Includes
+/* ------------------------------------------------------------------------- */
+
+#define FC85_BATCH
+#include "fc85.c"
+
+/* ------------------------------------------------------------------------- */
+// Macros
+/* ------------------------------------------------------------------------- */
+
+#define BATCH_MAX_THREADS       64
+#define BATCH_PATH_SIZE         256
+#define BATCH_FRAME_LIMIT       (60 * 60 * 10) // a run is cut off after 10 minutes of frames
+
+/* ------------------------------------------------------------------------- */
+// Types
+/* ------------------------------------------------------------------------- */
+
+typedef struct {
+  char script[BATCH_PATH_SIZE];
+  char disk[BATCH_PATH_SIZE];
+  dword frames;
+  double seconds;
+  dword hash;       // FNV-1a of the framebuffer after the last frame
+  bool timedOut;
+  byte worker;
+} BatchRun;
+
+struct _batch;
+
+// each worker owns a range of runs and takes from its front, an idle worker
+// steals the back half of someone else's range
+typedef struct {
+  struct _batch *batch;
+  byte id;
+  SDL_Thread *thread;
+  SDL_SpinLock lock;
+  dword next;
+  dword end;
+  dword runs;
+  dword steals;
+} BatchWorker;
+
+typedef struct _batch {
+  BatchRun *runs;
+  dword runCount;
+  byte workerCount;
+  BatchWorker workers[BATCH_MAX_THREADS];
+} Batch;
+
+/* ------------------------------------------------------------------------- */
+// Batch
+/* ------------------------------------------------------------------------- */
+
+static void batch_LoadManifest(Batch *self, const char *fileName)
+{
+  char line[BATCH_PATH_SIZE * 2];
+  dword capacity = 64;
+  FILE *fp = fopen(fileName, "r");
+  assert(fp != NULL);
+  self->runs = (BatchRun *)calloc(capacity, sizeof(BatchRun));
+  assert(self->runs);
+  while (fgets(line, sizeof(line), fp))
+  {
+    char script[BATCH_PATH_SIZE] = {'\0'};
+    char disk[BATCH_PATH_SIZE] = {'\0'};
+    if (line[0] == '#' || sscanf(line, "%255s %255s", script, disk) < 1)
+      continue;
+
+    if (self->runCount == capacity)
+    {
+      capacity *= 2;
+      self->runs = (BatchRun *)realloc(self->runs, capacity * sizeof(BatchRun));
+      assert(self->runs);
+    }
+    BatchRun *run = &self->runs[self->runCount];
+    self->runCount++;
+    memset(run, 0, sizeof(BatchRun));
+    strncpy(run->script, script, sizeof(run->script) - 1);
+    strncpy(run->disk, disk[0] ? disk : DISK_FILE_NAME, sizeof(run->disk) - 1);
+  }
+  fclose(fp);
+  printf("[FC-85] batch: loaded %u runs from %s\n", self->runCount, fileName);
+}
+
+static dword batch_HashFramebuffer(System *sys)
+{
+  dword hash = 2166136261u;
+  const byte *data = (const byte *)sys->mem.disp.buffer;
+  for (size_t b = 0; b < sizeof(sys->mem.disp.buffer); b++)
+  {
+    hash ^= data[b];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// every console is headless and mounts its disk as an overlay, so runs
+// share the mapped image and never write to it
+static void batch_Run(BatchRun *run)
+{
+  FC85 *fc85 = fc85_Create();
+  displayDevice_Initialize(&fc85->disp, true);
+  diskDevice_Initialize(&fc85->disk);
+  diskDevice_Mount(&fc85->disk, run->disk, false, true);
+  inputDevice_LoadScript(&fc85->inpt, run->script);
+  system_Boot(&fc85->sys);
+
+  Uint64 start = SDL_GetPerformanceCounter();
+  while (!system_IsShutdownFlagSet(&fc85->sys))
+  {
+    if (run->frames == BATCH_FRAME_LIMIT)
+    {
+      run->timedOut = true;
+      break;
+    }
+    tick(fc85);
+    run->frames++;
+  }
+  run->seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+  run->hash = batch_HashFramebuffer(&fc85->sys);
+
+  inputDevice_Dispose(&fc85->inpt);
+  diskDevice_Dispose(&fc85->disk);
+  displayDevice_Dispose(&fc85->disp);
+  fc85_Destroy(fc85);
+}
+
+static bool batchWorker_Take(BatchWorker *self, dword *run)
+{
+  bool taken = false;
+  SDL_AtomicLock(&self->lock);
+  if (self->next < self->end)
+  {
+    *run = self->next;
+    self->next++;
+    taken = true;
+  }
+  SDL_AtomicUnlock(&self->lock);
+  return taken;
+}
+
+static bool batchWorker_Steal(BatchWorker *self, dword *run)
+{
+  Batch *batch = self->batch;
+  for (byte w = 1; w < batch->workerCount; w++)
+  {
+    BatchWorker *victim = &batch->workers[(self->id + w) % batch->workerCount];
+    dword first = 0;
+    dword count = 0;
+    SDL_AtomicLock(&victim->lock);
+    if (victim->next < victim->end)
+    {
+      count = (victim->end - victim->next + 1) / 2;
+      victim->end -= count;
+      first = victim->end;
+    }
+    SDL_AtomicUnlock(&victim->lock);
+    if (count == 0)
+      continue;
+
+    SDL_AtomicLock(&self->lock);
+    self->next = first + 1;
+    self->end = first + count;
+    SDL_AtomicUnlock(&self->lock);
+    self->steals++;
+    *run = first;
+    return true;
+  }
+  return false;
+}
+
+// runs are never added once started, so a sweep that finds nothing to
+// steal means the batch is drained
+static int batchWorker_Main(void *data)
+{
+  BatchWorker *self = (BatchWorker *)data;
+  dword run;
+  while (batchWorker_Take(self, &run) || batchWorker_Steal(self, &run))
+  {
+    self->batch->runs[run].worker = self->id;
+    batch_Run(&self->batch->runs[run]);
+    self->runs++;
+  }
+  return 0;
+}
+
+static void batch_Execute(Batch *self)
+{
+  // contiguous slices up front keep stealing to the uneven tails
+  for (byte w = 0; w < self->workerCount; w++)
+  {
+    BatchWorker *worker = &self->workers[w];
+    memset(worker, 0, sizeof(BatchWorker));
+    worker->batch = self;
+    worker->id = w;
+    worker->next = (dword)((Uint64)self->runCount * w / self->workerCount);
+    worker->end = (dword)((Uint64)self->runCount * (w + 1) / self->workerCount);
+  }
+
+  for (byte w = 0; w < self->workerCount; w++)
+  {
+    self->workers[w].thread = SDL_CreateThread(batchWorker_Main, "fc85_batch", &self->workers[w]);
+    assert(self->workers[w].thread);
+  }
+
+  for (byte w = 0; w < self->workerCount; w++)
+    SDL_WaitThread(self->workers[w].thread, NULL);
+}
+
+static void batch_Report(Batch *self, double seconds)
+{
+  Uint64 frames = 0;
+  dword timedOut = 0;
+  for (dword r = 0; r < self->runCount; r++)
+  {
+    BatchRun *run = &self->runs[r];
+    frames += run->frames;
+    timedOut += run->timedOut ? 1 : 0;
+    printf("[FC-85] batch: %s %s frames:%u time:%.3fs hash:%08x worker:%u%s\n",
+      run->script, run->disk, run->frames, run->seconds, run->hash, run->worker,
+      run->timedOut ? " TIMED OUT" : "");
+  }
+
+  for (byte w = 0; w < self->workerCount; w++)
+    printf("[FC-85] batch: worker %u ran %u, stole %u times\n",
+      w, self->workers[w].runs, self->workers[w].steals);
+
+  printf("[FC-85] batch: %u runs, %u timed out, %llu frames in %.3fs on %u threads, %.0f frames/sec\n",
+    self->runCount, timedOut, (unsigned long long)frames, seconds, self->workerCount,
+    seconds > 0.0 ? frames / seconds : 0.0);
+}
+
+/* ------------------------------------------------------------------------- */
+// Entry Point
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+  const char *manifest = NULL;
+  int threads = SDL_GetCPUCount();
+  for (int a = 1; a < argc; a++)
+  {
+    if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) threads = atoi(argv[++a]);
+    else manifest = argv[a];
+  }
+
+  if (manifest == NULL)
+  {
+    printf("usage: fc85_batch [--threads n] <manifest>\n");
+    exit(EXIT_FAILURE);
+  }
+
+  Batch *batch = (Batch *)calloc(1, sizeof(Batch));
+  assert(batch);
+  batch_LoadManifest(batch, manifest);
+  batch->workerCount = (byte)max(1, min(threads, BATCH_MAX_THREADS));
+
+  Uint64 start = SDL_GetPerformanceCounter();
+  batch_Execute(batch);
+  batch_Report(batch, (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency());
+
+  free(batch->runs);
+  free(batch);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,566 @@
+#ifndef FC85_PROC_IMPLEMENTATIONS
+#ifndef _lang_h_
+#define _lang_h_
+/* ------------------------------------------------------------------------- */
+
+#define LANG_BUILDER_CAPACITY   1024
+#define LANG_LABELS_CAPACITY    16
+#define LANG_RUN_FUNC_NAME      "fc85run"
+#define LANG_ERROR_FUNC_NAME    "fc85error" // provided by whoever runs the chunk
+#define LANG_BLOCKS_NAME        "fc85blocks"
+#define LANG_LABEL_PREFIX       "fc85_"
+#define LANG_ENTRY_BLOCK        1
+#define LANG_NEST_BLOCK         'b'
+#define LANG_NEST_FUNCTION      'f'
+#define LANG_VERSION            4 // bump whenever the emitted Lua changes
+
+typedef enum {
+  TOKEN_INVALID = 0,
+  TOKEN_NUMBER,
+  TOKEN_IDENTIFIER,
+  TOKEN_STRING,
+  TOKEN_NOT,
+  TOKEN_STO,
+  TOKEN_AND,
+  TOKEN_DASH,
+  TOKEN_PLUS,
+  TOKEN_MULT,
+  TOKEN_DIVD,
+  TOKEN_LT,
+  TOKEN_GT,
+  TOKEN_EQ,
+  TOKEN_COLON,
+  TOKEN_SEMICOLON,
+  TOKEN_COMMA,
+  TOKEN_LEFT_PAREN,
+  TOKEN_RIGHT_PAREN,
+} TokenType;
+
+// a growable string that tracks its length, appends never rescan it
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+} LangBuilder;
+
+// a token is a slice of the source it was read from, nothing is copied
+typedef struct {
+  TokenType type;
+  dword offset;
+  dword length;
+} LangToken;
+
+// labels are all found before any code is emitted, so a Goto knows how to
+// reach a Lbl further down
+typedef struct {
+  dword offset;
+  dword length;
+  dword block;
+  bool defined;
+  bool nested;  // inside one of the game's own Lua blocks, a native label
+  bool emitted;
+} LangLabel;
+
+typedef struct {
+  LangLabel *data;
+  dword count;
+  dword capacity;
+} LangLabels;
+
+// all scanning state lives in the lexer, so any number of them can read
+// the same or different sources at once
+typedef struct {
+  const char *source;
+  size_t length;
+  size_t pos;
+} LangLexer;
+
+static void langLexer_Init(LangLexer *self, const char *source, size_t length);
+static bool langLexer_Next(LangLexer *self, LangToken *token);
+static char *lang_Transpile(const char *code, size_t codeLength, size_t *length, const char **error);
+
+/* ------------------------------------------------------------------------- */
+#endif
+#endif
+#ifdef FC85_PROC_IMPLEMENTATIONS
+#ifndef _lang_c_
+#define _lang_c_
+/* ------------------------------------------------------------------------- */
+
+static void langLexer_Init(LangLexer *self, const char *source, size_t length)
+{
+  assert(self && source);
+  self->source = source;
+  self->length = length;
+  self->pos = 0;
+}
+
+static bool langLexer_IsIdentifier(char c)
+{
+  return isalnum((unsigned char)c) || c == '_';
+}
+
+static TokenType langLexer_Symbol(char c)
+{
+  switch (c)
+  {
+    case '!': return TOKEN_NOT;
+    case '|': return TOKEN_STO;
+    case '&': return TOKEN_AND;
+    case '-': return TOKEN_DASH;
+    case '+': return TOKEN_PLUS;
+    case '*': return TOKEN_MULT;
+    case '/': return TOKEN_DIVD;
+    case '<': return TOKEN_LT;
+    case '>': return TOKEN_GT;
+    case '=': return TOKEN_EQ;
+    case ':': return TOKEN_COLON;
+    case ';': return TOKEN_SEMICOLON;
+    case '(': return TOKEN_LEFT_PAREN;
+    case ')': return TOKEN_RIGHT_PAREN;
+    case ',': return TOKEN_COMMA;
+  }
+  return TOKEN_INVALID;
+}
+
+// false at the end of the source, a character the language does not know
+// comes back as a one character TOKEN_INVALID
+static bool langLexer_Next(LangLexer *self, LangToken *token)
+{
+  const char *src = self->source;
+  size_t pos = self->pos;
+  size_t end = self->length;
+
+  while (pos < end && isspace((unsigned char)src[pos]))
+    pos++;
+
+  if (pos == end)
+  {
+    self->pos = pos;
+    return false;
+  }
+
+  size_t start = pos;
+  if (isdigit((unsigned char)src[pos]))
+  {
+    while (pos < end && isdigit((unsigned char)src[pos]))
+      pos++;
+    token->type = TOKEN_NUMBER;
+  }
+  else if (isalpha((unsigned char)src[pos]) || src[pos] == '_')
+  {
+    while (pos < end && langLexer_IsIdentifier(src[pos]))
+      pos++;
+    token->type = TOKEN_IDENTIFIER;
+  }
+  else if (src[pos] == '"')
+  {
+    // the slice is the text between the quotes, a string ends at the line
+    start = ++pos;
+    while (pos < end && src[pos] != '"' && src[pos] != '\n')
+      pos++;
+    token->type = TOKEN_STRING;
+    token->offset = (dword)start;
+    token->length = (dword)(pos - start);
+    self->pos = pos < end ? pos + 1 : pos;
+    return true;
+  }
+  else
+  {
+    token->type = langLexer_Symbol(src[pos]);
+    pos++;
+  }
+
+  token->offset = (dword)start;
+  token->length = (dword)(pos - start);
+  self->pos = pos;
+  return true;
+}
+
+static bool langLexer_Is(const LangLexer *self, const LangToken *token, const char *text)
+{
+  return strlen(text) == token->length &&
+    memcmp(self->source + token->offset, text, token->length) == 0;
+}
+
+static void langBuilder_Init(LangBuilder *self)
+{
+  self->capacity = LANG_BUILDER_CAPACITY;
+  self->length = 0;
+  self->data = (char *)malloc(self->capacity);
+  assert(self->data);
+  self->data[0] = '\0';
+}
+
+static void langBuilder_Dispose(LangBuilder *self)
+{
+  free(self->data);
+  memset(self, 0, sizeof(LangBuilder));
+}
+
+static void langBuilder_Clear(LangBuilder *self)
+{
+  self->length = 0;
+  self->data[0] = '\0';
+}
+
+// the capacity doubles, so appends cost amortized time in their own length
+static void langBuilder_Append(LangBuilder *self, const char *str, size_t len)
+{
+  if (self->length + len + 1 > self->capacity)
+  {
+    while (self->length + len + 1 > self->capacity)
+      self->capacity *= 2;
+    self->data = (char *)realloc(self->data, self->capacity);
+    assert(self->data);
+  }
+  memcpy(self->data + self->length, str, len);
+  self->length += len;
+  self->data[self->length] = '\0';
+}
+
+static void langBuilder_Puts(LangBuilder *self, const char *str)
+{
+  langBuilder_Append(self, str, strlen(str));
+}
+
+static void langBuilder_Number(LangBuilder *self, dword number)
+{
+  char digits[16];
+  langBuilder_Append(self, digits, sprintf(digits, "%u", number));
+}
+
+static void langLabels_Init(LangLabels *self)
+{
+  self->capacity = LANG_LABELS_CAPACITY;
+  self->count = 0;
+  self->data = (LangLabel *)malloc(self->capacity * sizeof(LangLabel));
+  assert(self->data);
+}
+
+static void langLabels_Dispose(LangLabels *self)
+{
+  free(self->data);
+  memset(self, 0, sizeof(LangLabels));
+}
+
+// the label named by the token, added without a block when it is new
+static LangLabel *langLabels_Find(LangLabels *self, const LangLexer *lexer, const LangToken *token)
+{
+  for (dword l = 0; l < self->count; l++)
+  {
+    LangLabel *label = &self->data[l];
+    if (label->length == token->length &&
+      memcmp(lexer->source + label->offset, lexer->source + token->offset, token->length) == 0)
+      return label;
+  }
+
+  if (self->count == self->capacity)
+  {
+    self->capacity *= 2;
+    self->data = (LangLabel *)realloc(self->data, self->capacity * sizeof(LangLabel));
+    assert(self->data);
+  }
+  LangLabel *label = &self->data[self->count];
+  self->count++;
+  label->offset = token->offset;
+  label->length = token->length;
+  label->block = 0;
+  label->defined = false;
+  label->nested = false;
+  label->emitted = false;
+  return label;
+}
+
+// follows the game's own Lua blocks, the stack holds the kind of each one
+// that is open
+static void lang_Nest(LangBuilder *nesting, const LangLexer *lexer, const LangToken *token)
+{
+  static const char function = LANG_NEST_FUNCTION;
+  static const char block = LANG_NEST_BLOCK;
+  if (token->type != TOKEN_IDENTIFIER)
+    return;
+
+  if (langLexer_Is(lexer, token, "function"))
+  {
+    langBuilder_Append(nesting, &function, 1);
+  }
+  else if (langLexer_Is(lexer, token, "do") || langLexer_Is(lexer, token, "then") ||
+    langLexer_Is(lexer, token, "repeat"))
+  {
+    langBuilder_Append(nesting, &block, 1);
+  }
+  else if ((langLexer_Is(lexer, token, "end") || langLexer_Is(lexer, token, "until") ||
+    langLexer_Is(lexer, token, "elseif")) && nesting->length > 0)
+  {
+    nesting->length--;
+    nesting->data[nesting->length] = '\0';
+  }
+}
+
+// numbers every Lbl, notes whether it sits inside one of the game's own
+// Lua blocks and where the last one at the top level is
+static dword lang_ResolveLabels(LangLabels *labels, const char *code, size_t codeLength, dword *lastTopLabel)
+{
+  LangBuilder nesting;
+  langBuilder_Init(&nesting);
+  dword blocks = LANG_ENTRY_BLOCK;
+  bool labelNext = false;
+  bool gotoNext = false;
+  *lastTopLabel = 0;
+
+  LangLexer lexer;
+  LangToken token;
+  langLexer_Init(&lexer, code, codeLength);
+  while (langLexer_Next(&lexer, &token) && token.type != TOKEN_INVALID)
+  {
+    if (labelNext)
+    {
+      LangLabel *label = langLabels_Find(labels, &lexer, &token);
+      if (!label->defined)
+      {
+        label->defined = true;
+        label->nested = nesting.length > 0;
+        label->block = ++blocks;
+      }
+      labelNext = false;
+    }
+    else if (gotoNext)
+    {
+      gotoNext = false;
+    }
+    else if (token.type == TOKEN_IDENTIFIER && langLexer_Is(&lexer, &token, "Lbl"))
+    {
+      labelNext = true;
+      if (nesting.length == 0)
+        *lastTopLabel = token.offset;
+    }
+    else if (token.type == TOKEN_IDENTIFIER && langLexer_Is(&lexer, &token, "Goto"))
+    {
+      gotoNext = true;
+    }
+    else
+    {
+      lang_Nest(&nesting, &lexer, &token);
+    }
+  }
+
+  langBuilder_Dispose(&nesting);
+  return blocks;
+}
+
+static void lang_OpenBlock(LangBuilder *out, dword block)
+{
+  langBuilder_Puts(out, LANG_BLOCKS_NAME"[");
+  langBuilder_Number(out, block);
+  langBuilder_Puts(out, "] = function()\n::"LANG_LABEL_PREFIX);
+  langBuilder_Number(out, block);
+  langBuilder_Puts(out, "::");
+}
+
+// turns a game's code into a Lua chunk defining LANG_RUN_FUNC_NAME, the
+// caller frees the result. NULL with the reason in error when the game
+// cannot be transpiled. Statements are no longer followed by a yield, the
+// play process preempts the game on an instruction budget instead.
+//
+// Every Lbl at the top level starts a new block, a function in
+// LANG_BLOCKS_NAME that returns the number of the block to run next, and
+// the run function dispatches on that number until a block returns
+// nothing. A Goto back to the start of its own block stays a native goto,
+// any other is a return, so jumps work across blocks without Lua's label
+// scoping. A Lbl inside one of the game's own Lua blocks, and any Goto to
+// it or made from inside a game function, stays a native label and goto
+// with Lua's rules. A game's own local at the top level would end at the
+// next Lbl, so one placed before a top level Lbl is refused.
+static char *lang_Transpile(const char *code, size_t codeLength, size_t *length, const char **error)
+{
+  LangBuilder out;
+  LangBuilder line;
+  LangBuilder swap;
+  LangBuilder nesting;
+  langBuilder_Init(&out);
+  langBuilder_Init(&line);
+  langBuilder_Init(&swap);
+  langBuilder_Init(&nesting);
+  LangBuilder *buffer = &line;
+  LangLabels labels;
+  langLabels_Init(&labels);
+  bool closeParen = false;
+  bool labelNext = false;
+  bool gotoNext = false;
+  const char *failure = NULL;
+  dword lastTopLabel;
+  dword blocks = lang_ResolveLabels(&labels, code, codeLength, &lastTopLabel);
+  dword block = LANG_ENTRY_BLOCK;
+
+  // the variables A-Z are locals of the run function and every block
+  // closes over them, so game code reaches them as upvalues by index
+  // instead of looking them up in _G on every access
+  langBuilder_Puts(&out, "function "LANG_RUN_FUNC_NAME"()\n");
+  langBuilder_Puts(&out, "local A, B, C, D, E, F, G, H, I, J, K, L, M, "
+    "N, O, P, Q, R, S, T, U, V, W, X, Y, Z\n");
+  langBuilder_Puts(&out, "local "LANG_BLOCKS_NAME" = {}\n");
+  lang_OpenBlock(&out, LANG_ENTRY_BLOCK);
+  langBuilder_Puts(&out, "\n");
+
+  LangLexer lexer;
+  LangToken token;
+  langLexer_Init(&lexer, code, codeLength);
+  while (!failure && langLexer_Next(&lexer, &token) && token.type != TOKEN_INVALID)
+  {
+    const char *text = code + token.offset;
+    if (labelNext)
+    {
+      // only the first Lbl of a name is a Goto target
+      LangLabel *label = langLabels_Find(&labels, &lexer, &token);
+      dword target = label->emitted ? ++blocks : label->block;
+      label->emitted = true;
+      if (nesting.length > 0)
+      {
+        langBuilder_Puts(buffer, "::"LANG_LABEL_PREFIX);
+        langBuilder_Number(buffer, target);
+        langBuilder_Puts(buffer, "::");
+      }
+      else
+      {
+        // the open block falls through
+        langBuilder_Puts(buffer, "return ");
+        langBuilder_Number(buffer, target);
+        langBuilder_Puts(buffer, "\nend\n");
+        lang_OpenBlock(buffer, target);
+        block = target;
+      }
+      labelNext = false;
+      continue;
+    }
+
+    if (gotoNext)
+    {
+      LangLabel *label = langLabels_Find(&labels, &lexer, &token);
+      bool inFunction = memchr(nesting.data, LANG_NEST_FUNCTION, nesting.length) != NULL;
+      if (!label->defined)
+      {
+        // a Goto to a missing Lbl fails when it is taken, like it would on a TI
+        langBuilder_Puts(buffer, " "LANG_ERROR_FUNC_NAME"(\"undefined label ");
+        langBuilder_Append(buffer, text, token.length);
+        langBuilder_Puts(buffer, "\") ");
+      }
+      else if (label->nested || inFunction || (label->emitted && label->block == block))
+      {
+        langBuilder_Puts(buffer, " goto "LANG_LABEL_PREFIX);
+        langBuilder_Number(buffer, label->block);
+        langBuilder_Puts(buffer, " ");
+      }
+      else
+      {
+        langBuilder_Puts(buffer, " do return ");
+        langBuilder_Number(buffer, label->block);
+        langBuilder_Puts(buffer, " end ");
+      }
+      gotoNext = false;
+      continue;
+    }
+
+    switch (token.type)
+    {
+      case TOKEN_STO:
+        if (closeParen)
+        {
+          langBuilder_Puts(buffer, ")");
+          closeParen = false;
+        }
+        buffer = &swap;
+        break;
+
+      case TOKEN_COLON:
+        if (swap.length > 0)
+        {
+          langBuilder_Append(&out, swap.data, swap.length);
+          langBuilder_Puts(&out, " = ");
+        }
+        if (closeParen)
+        {
+          langBuilder_Puts(&line, ")");
+          closeParen = false;
+        }
+        langBuilder_Append(&out, line.data, line.length);
+        langBuilder_Puts(&out, "\n");
+        langBuilder_Clear(&line);
+        langBuilder_Clear(&swap);
+        buffer = &line;
+        break;
+
+      case TOKEN_STRING:
+        langBuilder_Puts(buffer, " \"");
+        langBuilder_Append(buffer, text, token.length);
+        langBuilder_Puts(buffer, "\" ");
+        break;
+
+      case TOKEN_IDENTIFIER:
+        langBuilder_Puts(buffer, " ");
+        if (langLexer_Is(&lexer, &token, "Disp"))
+        {
+          langBuilder_Puts(buffer, "Disp(");
+          closeParen = true;
+        }
+        else if (langLexer_Is(&lexer, &token, "Lbl"))
+        {
+          labelNext = true;
+        }
+        else if (langLexer_Is(&lexer, &token, "Goto"))
+        {
+          gotoNext = true;
+        }
+        else if (nesting.length == 0 && token.offset < lastTopLabel &&
+          langLexer_Is(&lexer, &token, "local"))
+        {
+          failure = "a local at the top level cannot reach past a Lbl, use A-Z";
+        }
+        else
+        {
+          lang_Nest(&nesting, &lexer, &token);
+          langBuilder_Append(buffer, text, token.length);
+          langBuilder_Puts(buffer, " ");
+        }
+        break;
+
+      default:
+        langBuilder_Puts(buffer, " ");
+        langBuilder_Append(buffer, text, token.length);
+        langBuilder_Puts(buffer, " ");
+        break;
+    }
+  }
+
+  if (swap.length > 0)
+  {
+    langBuilder_Append(&out, swap.data, swap.length);
+    langBuilder_Puts(&out, " = ");
+  }
+  if (closeParen)
+    langBuilder_Puts(&line, ")");
+  langBuilder_Append(&out, line.data, line.length);
+  langBuilder_Puts(&out, "\nend\n");
+  langBuilder_Puts(&out, "local fc85pc = ");
+  langBuilder_Number(&out, LANG_ENTRY_BLOCK);
+  langBuilder_Puts(&out, "\nwhile fc85pc do\nfc85pc = "LANG_BLOCKS_NAME"[fc85pc]()\nend\nend\n");
+
+  langLabels_Dispose(&labels);
+  langBuilder_Dispose(&nesting);
+  langBuilder_Dispose(&line);
+  langBuilder_Dispose(&swap);
+  if (failure)
+  {
+    langBuilder_Dispose(&out);
+    if (error)
+      *error = failure;
+    return NULL;
+  }
+  if (length)
+    *length = out.length;
+  return out.data;
+}
+
+/* ------------------------------------------------------------------------- */
+#endif
+#endif
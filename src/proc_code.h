@@ -12,6 +12,8 @@ typedef struct {
 } CodeProcess;
 
 static void codeProcess_Execute(System *sys);
+static void codeProcess_Save(CodeProcess *self, System *sys, byte *state);
+static void codeProcess_Resume(System *sys, const byte *state);
 
 /* ------------------------------------------------------------------------- */
 #endif
@@ -21,10 +23,9 @@ static void codeProcess_Execute(System *sys);
 #define _proc_code_c_
 /* ------------------------------------------------------------------------- */
 
-static CodeProcess *codeProcess_Create()
+static CodeProcess *codeProcess_Create(System *sys)
 {
-  CodeProcess *self = (CodeProcess *)calloc(1, sizeof(CodeProcess));
-  assert(self);
+  CodeProcess *self = (CodeProcess *)processArena_Alloc(sys->procArena, PROC_TYPE_CODE);
   return self;
 }
 
@@ -32,7 +33,6 @@ static void codeProcess_Destroy(CodeProcess *self)
 {
   assert(self);
   memset(self, 0, sizeof(CodeProcess));
-  free(self);
 }
 
 static void codeProcess_Tick(CodeProcess *self, System *sys)
@@ -51,8 +51,21 @@ static void codeProcess_Tick(CodeProcess *self, System *sys)
 
 static void codeProcess_Execute(System *sys)
 {
-  CodeProcess *proc = codeProcess_Create();
-  system_PushProc(sys, proc, codeProcess_Tick, NULL, codeProcess_Destroy);
+  CodeProcess *proc = codeProcess_Create(sys);
+  system_PushProc(sys, PROC_TYPE_CODE, proc, codeProcess_Tick, NULL, codeProcess_Destroy);
+}
+
+static void codeProcess_Save(CodeProcess *self, System *sys, byte *state)
+{
+  assert(sizeof(CodeProcess) <= PROC_STATE_SIZE);
+  memcpy(state, self, sizeof(CodeProcess));
+}
+
+static void codeProcess_Resume(System *sys, const byte *state)
+{
+  codeProcess_Execute(sys);
+  CodeProcess *self = (CodeProcess *)sys->procStack[sys->procCount - 1].data;
+  memcpy(self, state, sizeof(CodeProcess));
 }
 
 /* ------------------------------------------------------------------------- */
@@ -5,11 +5,15 @@
 
 #include "proc_edit.h"
 
+#define CREATE_STATE_PROMPT     0
+#define CREATE_STATE_NAME       1
+
 typedef struct {
-  bool pass;
+  byte state;
 } CreateProcess;
 
 static void createProcess_Execute(System *sys);
+static void createProcess_Resume(System *sys, const byte *state);
 
 /* ------------------------------------------------------------------------- */
 #endif
@@ -19,10 +23,9 @@ static void createProcess_Execute(System *sys);
 #define _proc_create_c_
 /* ------------------------------------------------------------------------- */
 
-static CreateProcess *createProcess_Create()
+static CreateProcess *createProcess_Create(System *sys)
 {
-  CreateProcess *self = (CreateProcess *)calloc(1, sizeof(CreateProcess));
-  assert(self);
+  CreateProcess *self = (CreateProcess *)processArena_Alloc(sys->procArena, PROC_TYPE_CREATE);
   return self;
 }
 
@@ -30,37 +33,52 @@ static void createProcess_Destroy(CreateProcess *self)
 {
   assert(self);
   memset(self, 0, sizeof(CreateProcess));
-  free(self);
 }
 
 static void createProcess_Tick(CreateProcess *self, System *sys)
 {
-  _clrHome(sys);
-  _disp(sys, "GAME:CREATE", true);
-  if (_input(sys, "Name="))
+  if (self->state == CREATE_STATE_PROMPT)
   {
-    printf("[FC-85] creating %s\n", sys->mem.home.inputBuffer);
-    memset(sys->mem.appl, 0, sizeof(sys->mem.appl));
-    Game *game = (Game *)sys->mem.appl;
-    strncpy(game->content.name, sys->mem.home.inputBuffer,
-      sizeof(game->content.name) - 1);
-
-    memset(sys->mem.disk.name, 0, sizeof(sys->mem.disk.name));
-    memcpy(sys->mem.disk.name, game->content.name, 
-      min(sizeof(sys->mem.disk.name), sizeof(game->content.name)));
-    memcpy(sys->mem.disk.buffer, game, sizeof(Game));
-    sys->mem.disk.code = DISK_CODE_WRITE;
-    _interrupt(sys, INTERRUPT_CODE_DISK);
+    _clrHome(sys);
+    _disp(sys, "GAME:CREATE", true);
+    _input(sys, "Name=");
+    self->state = CREATE_STATE_NAME;
+    return;
+  }
 
+  // resumed after the prompt was answered or escaped
+  if (_inputStatus(sys) != HOME_INPUT_ACCEPTED)
+  {
     system_PopProc(sys);
-    editProcess_Execute(sys);
+    return;
   }
+
+  printf("[FC-85] creating %s\n", sys->mem.home.inputBuffer);
+  memset(sys->mem.appl, 0, sizeof(sys->mem.appl));
+  Game *game = (Game *)sys->mem.appl;
+  strncpy(game->content.name, sys->mem.home.inputBuffer,
+    sizeof(game->content.name) - 1);
+
+  memset(sys->mem.disk.name, 0, sizeof(sys->mem.disk.name));
+  memcpy(sys->mem.disk.name, game->content.name, 
+    min(sizeof(sys->mem.disk.name), sizeof(game->content.name)));
+  memcpy(sys->mem.disk.buffer, game, sizeof(Game));
+  sys->mem.disk.code = DISK_CODE_WRITE;
+  _interrupt(sys, INTERRUPT_CODE_DISK);
+
+  system_PopProc(sys);
+  editProcess_Execute(sys);
 }
 
 static void createProcess_Execute(System *sys)
 {
-  CreateProcess *sysProc = createProcess_Create();
-  system_PushProc(sys, sysProc, createProcess_Tick, NULL, createProcess_Destroy);
+  CreateProcess *sysProc = createProcess_Create(sys);
+  system_PushProc(sys, PROC_TYPE_CREATE, sysProc, createProcess_Tick, NULL, createProcess_Destroy);
+}
+
+static void createProcess_Resume(System *sys, const byte *state)
+{
+  createProcess_Execute(sys);
 }
 
 /* ------------------------------------------------------------------------- */
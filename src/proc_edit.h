@@ -4,12 +4,15 @@
 /* ------------------------------------------------------------------------- */
 
 #include "proc_code.h"
+#include "proc_play.h"
 
 typedef struct {
   MenuProcess base;
 } EditProcess;
 
 static void editProcess_Execute(System *sys);
+static void editProcess_Save(EditProcess *self, System *sys, byte *state);
+static void editProcess_Resume(System *sys, const byte *state);
 
 /* ------------------------------------------------------------------------- */
 #endif
@@ -24,30 +27,29 @@ static void editProcess_menuItem_CodeExecute(MenuItem *self, System *sys)
   codeProcess_Execute(sys);
 }
 
+static void editProcess_menuItem_PlayExecute(MenuItem *self, System *sys)
+{
+  playProcess_Execute(sys);
+}
+
 static EditProcess *editProcess_Create(System *sys)
 {
-  EditProcess *self = (EditProcess *)calloc(1, sizeof(EditProcess));
-  assert(self);
+  EditProcess *self = (EditProcess *)processArena_Alloc(sys->procArena, PROC_TYPE_EDIT);
 
   Game *game = (Game *)sys->mem.appl;
 
-  MenuTab tab;
-  MenuItem item;
+  byte tabName[MENU_TAB_NAME_SIZE] = {'\0'};
+  strncpy(tabName, "GAME:", sizeof(tabName) - 1);
+  strncat(tabName, game->content.name, sizeof(tabName) - strlen(tabName) - 1);
+  MenuTab *tab = menuProcess_AddTab(&self->base, tabName);
+  MenuItem *item;
 
-  memset(&tab, 0, sizeof(tab));
-  strncpy(tab.name, "GAME:", sizeof(tab.name) - 1);
-  strncat(tab.name, game->content.name, sizeof(tab.name) - strlen(tab.name) - 1);
+  item = menuProcess_AddItem(&self->base, tab, "Edit Code", NULL);
+  item->execute = editProcess_menuItem_CodeExecute;
 
-  memset(&item, 0, sizeof(item));
-  strncpy(item.name, "Edit Code", sizeof(item.name) - 1);
-  item.execute = editProcess_menuItem_CodeExecute;
-  menuTab_AddItem(&tab, &item);
+  item = menuProcess_AddItem(&self->base, tab, "Play", NULL);
+  item->execute = editProcess_menuItem_PlayExecute;
 
-  memset(&item, 0, sizeof(item));
-  strncpy(item.name, "Play", sizeof(item.name) - 1);
-  menuTab_AddItem(&tab, &item);
-
-  menuProcess_AddTab(&self->base, &tab);
   return self;
 }
 
@@ -55,7 +57,11 @@ static void editProcess_Destroy(EditProcess *self)
 {
   assert(self);
   memset(self, 0, sizeof(EditProcess));
-  free(self);
+}
+
+static void editProcess_Restore(EditProcess *self, System *sys)
+{
+  menuProcess_Invalidate(&self->base);
 }
 
 static void editProcess_Tick(EditProcess *self, System *sys)
@@ -66,7 +72,20 @@ static void editProcess_Tick(EditProcess *self, System *sys)
 static void editProcess_Execute(System *sys)
 {
   EditProcess *proc = editProcess_Create(sys);
-  system_PushProc(sys, proc, editProcess_Tick, NULL, editProcess_Destroy);
+  system_PushProc(sys, PROC_TYPE_EDIT, proc, editProcess_Tick, editProcess_Restore, editProcess_Destroy);
+}
+
+static void editProcess_Save(EditProcess *self, System *sys, byte *state)
+{
+  menuProcess_SaveState(&self->base, state);
+}
+
+static void editProcess_Resume(System *sys, const byte *state)
+{
+  // the game being edited is part of the snapshot in appl memory
+  editProcess_Execute(sys);
+  EditProcess *self = (EditProcess *)sys->procStack[sys->procCount - 1].data;
+  menuProcess_LoadState(&self->base, state);
 }
 
 /* ------------------------------------------------------------------------- */
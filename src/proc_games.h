@@ -11,6 +11,8 @@ typedef struct {
 } GamesProcess;
 
 static void gamesProcess_Execute(System *sys);
+static void gamesProcess_Save(GamesProcess *self, System *sys, byte *state);
+static void gamesProcess_Resume(System *sys, const byte *state);
 
 /* ------------------------------------------------------------------------- */
 #endif
@@ -23,7 +25,7 @@ static void gamesProcess_Execute(System *sys);
 static void gamesProcess_LoadGameFile(MenuItem *self, System *sys)
 {
   strncpy(sys->mem.disk.name, self->name, 
-    min(sizeof(sys->mem.disk.name), sizeof(self->name)) - 1);
+    min(sizeof(sys->mem.disk.name), MENU_ITEM_NAME_SIZE) - 1);
   sys->mem.disk.code = DISK_CODE_READ;
   _interrupt(sys, INTERRUPT_CODE_DISK);
   memset(sys->mem.appl, 0, sizeof(sys->mem.appl));
@@ -31,9 +33,23 @@ static void gamesProcess_LoadGameFile(MenuItem *self, System *sys)
     min(sizeof(sys->mem.appl), sizeof(sys->mem.disk.buffer)));
 }
 
+static void gamesProcess_menuItem_Prefetch(MenuItem *self, System *sys)
+{
+  // left pending so the disk device stages the file at the end of the frame
+  if (sys->mem.disk.code != DISK_CODE_NONE)
+    return;
+  memset(sys->mem.disk.name, 0, sizeof(sys->mem.disk.name));
+  strncpy(sys->mem.disk.name, self->name, 
+    min(sizeof(sys->mem.disk.name), MENU_ITEM_NAME_SIZE) - 1);
+  sys->mem.disk.code = DISK_CODE_PREFETCH;
+}
+
 static void gamesProcess_menuItem_PlayExecute(MenuItem *self, System *sys)
 {
   gamesProcess_LoadGameFile(self, sys);
+  sys->mem.disk.code = DISK_CODE_PLAY;
+  _interrupt(sys, INTERRUPT_CODE_DISK);
+  playProcess_Execute(sys);
 }
 
 static void gamesProcess_menuItem_EditExecute(MenuItem *self, System *sys)
@@ -47,60 +63,73 @@ static void gamesProcess_menuItem_CreateGameExecute(MenuItem *self, System *sys)
   createProcess_Execute(sys);
 }
 
+static void gamesProcess_FormatSize(dword size, byte *tag, size_t tagSize)
+{
+  if (size < 1024)
+    snprintf(tag, tagSize, "%uB", size);
+  else
+    snprintf(tag, tagSize, "%uK", (size + 1023) / 1024);
+}
+
+static void gamesProcess_FormatPlayed(dword played, dword now, byte *tag, size_t tagSize)
+{
+  dword age = now > played ? now - played : 0;
+  if (played == 0)
+    snprintf(tag, tagSize, "new");
+  else if (age < 60)
+    snprintf(tag, tagSize, "now");
+  else if (age < 60 * 60)
+    snprintf(tag, tagSize, "%um", age / 60);
+  else if (age < 60 * 60 * 24)
+    snprintf(tag, tagSize, "%uh", age / (60 * 60));
+  else
+    snprintf(tag, tagSize, "%ud", age / (60 * 60 * 24));
+}
+
 static void gameProcess_ReloadMenu(GamesProcess *self, System *sys)
 {
-  memset(&self->base, 0, sizeof(self->base));
+  menuProcess_Clear(&self->base);
 
-  MenuTab tab;
-  MenuItem item;
+  MenuTab *tab;
+  MenuItem *item;
+  byte tag[MENU_ITEM_TAG_SIZE];
 
   sys->mem.disk.code = DISK_CODE_DIR;
   _interrupt(sys, INTERRUPT_CODE_DISK);
-  struct _file **dir = (struct _file **)sys->mem.disk.buffer;
+  struct _file *dir = (struct _file *)sys->mem.disk.buffer;
 
-  // PLAY Tab
+  // PLAY and EDIT Tabs, built from the directory records alone, the EDIT
+  // items share the interned names of the PLAY items
 
-  memset(&tab, 0, sizeof(tab));
-  strncpy(tab.name, "PLAY", sizeof(tab.name) - 1);
-  for (int i = 0; dir[i] != NULL; i++)
+  tab = menuProcess_AddTab(&self->base, "PLAY");
+  for (int i = 0; dir[i].name[0] != '\0' && i < MENU_MAX_MENU_ITEMS; i++)
   {
-    memset(&item, 0, sizeof(item));
-    strncpy(item.name, dir[i]->name, min(sizeof(item.name) - 1, sizeof(dir[i]->name) - 1));
-    item.execute = gamesProcess_menuItem_PlayExecute;
-    menuTab_AddItem(&tab, &item);      
+    gamesProcess_FormatPlayed(dir[i].played, sys->mem.sys.clock, tag, sizeof(tag));
+    item = menuProcess_AddItem(&self->base, tab, dir[i].name, tag);
+    item->execute = gamesProcess_menuItem_PlayExecute;
+    item->select = gamesProcess_menuItem_Prefetch;
   }
-  menuProcess_AddTab(&self->base, &tab);
-
-  // EDIT Tab
 
-  memset(&tab, 0, sizeof(tab));
-  strncpy(tab.name, "EDIT", sizeof(tab.name) - 1);
-  for (int i = 0; dir[i] != NULL; i++)
+  tab = menuProcess_AddTab(&self->base, "EDIT");
+  for (int i = 0; dir[i].name[0] != '\0' && i < MENU_MAX_MENU_ITEMS; i++)
   {
-    memset(&item, 0, sizeof(item));
-    strncpy(item.name, dir[i]->name, min(sizeof(item.name) - 1, sizeof(dir[i]->name) - 1));
-    item.execute = gamesProcess_menuItem_EditExecute;
-    menuTab_AddItem(&tab, &item);
+    gamesProcess_FormatSize(dir[i].size, tag, sizeof(tag));
+    item = menuProcess_AddItem(&self->base, tab, dir[i].name, tag);
+    item->execute = gamesProcess_menuItem_EditExecute;
   }
-  menuProcess_AddTab(&self->base, &tab);
 
   // NEW Tab
 
-  memset(&tab, 0, sizeof(tab));
-  strncpy(tab.name, "NEW", sizeof(tab.name) - 1);
-  
-  memset(&item, 0, sizeof(item));
-  strncpy(item.name, "Create Game", sizeof(item.name) - 1);
-  item.execute = gamesProcess_menuItem_CreateGameExecute;
-  menuTab_AddItem(&tab, &item);
-  
-  menuProcess_AddTab(&self->base, &tab);
+  tab = menuProcess_AddTab(&self->base, "NEW");
+  item = menuProcess_AddItem(&self->base, tab, "Create Game", NULL);
+  item->execute = gamesProcess_menuItem_CreateGameExecute;
+
+  menuTab_Select(&self->base.tabs[self->base.active], sys);
 }
 
 static GamesProcess *gamesProcess_Create(System *sys)
 {
-  GamesProcess *self = (GamesProcess *)calloc(1, sizeof(GamesProcess));
-  assert(self);
+  GamesProcess *self = (GamesProcess *)processArena_Alloc(sys->procArena, PROC_TYPE_GAMES);
   gameProcess_ReloadMenu(self, sys);
   return self;
 }
@@ -109,7 +138,6 @@ static void gamesProcess_Destroy(GamesProcess *self)
 {
   assert(self);
   memset(self, 0, sizeof(GamesProcess));
-  free(self);
 }
 
 static void gamesProcess_Tick(GamesProcess *self, System *sys)
@@ -120,7 +148,19 @@ static void gamesProcess_Tick(GamesProcess *self, System *sys)
 static void gamesProcess_Execute(System *sys)
 {
   GamesProcess *sysProc = gamesProcess_Create(sys);
-  system_PushProc(sys, sysProc, gamesProcess_Tick, gameProcess_ReloadMenu, gamesProcess_Destroy);
+  system_PushProc(sys, PROC_TYPE_GAMES, sysProc, gamesProcess_Tick, gameProcess_ReloadMenu, gamesProcess_Destroy);
+}
+
+static void gamesProcess_Save(GamesProcess *self, System *sys, byte *state)
+{
+  menuProcess_SaveState(&self->base, state);
+}
+
+static void gamesProcess_Resume(System *sys, const byte *state)
+{
+  gamesProcess_Execute(sys);
+  GamesProcess *self = (GamesProcess *)sys->procStack[sys->procCount - 1].data;
+  menuProcess_LoadState(&self->base, state);
 }
 
 /* ------------------------------------------------------------------------- */
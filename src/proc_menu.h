@@ -5,22 +5,32 @@
 
 #define MENU_MAX_TABS           32
 #define MENU_TAB_NAME_SIZE      16
-#define MENU_MAX_MENU_ITEMS     32
+#define MENU_MAX_MENU_ITEMS     32 // per tab
+#define MENU_MAX_POOL_ITEMS     80 // across all tabs of a menu
 #define MENU_ITEM_NAME_SIZE     16
 #define MENU_ITEM_TAG_SIZE      16
+#define MENU_NAMES_SIZE         2048
+#define MENU_VISIBLE_ITEMS      7
+#define MENU_ROWS_NONE          0x00
+#define MENU_ROWS_ITEMS         0xFE
+#define MENU_ROWS_ALL           0xFF
 
+// names and tags point into the menu's interned string pool, so an item
+// listed on several tabs shares one copy of its name
 typedef struct {
-  byte name[MENU_ITEM_NAME_SIZE];
-  byte tag[MENU_ITEM_TAG_SIZE];
+  byte *name;
+  byte *tag;
   void (*execute)(void *, void *);
+  void (*select)(void *, void *);
 } MenuItem;
 
+// a tab is a contiguous range of the menu's item pool
 typedef struct {
-  byte name[MENU_TAB_NAME_SIZE];
+  byte *name;
+  MenuItem *items;
   byte head;
   byte active;
   byte count;
-  MenuItem items[MENU_MAX_MENU_ITEMS];
 } MenuTab;
 
 typedef struct {
@@ -28,6 +38,11 @@ typedef struct {
   byte active;
   byte count;
   MenuTab tabs[MENU_MAX_TABS];
+  byte itemCount;
+  MenuItem items[MENU_MAX_POOL_ITEMS];
+  word namesSize;
+  byte names[MENU_NAMES_SIZE];
+  byte dirtyRows; // bit per char cell row still to be redrawn
 } MenuProcess;
 
 /* ------------------------------------------------------------------------- */
@@ -38,19 +53,101 @@ typedef struct {
 #define _proc_menu_c_
 /* ------------------------------------------------------------------------- */
 
-static void menuTab_AddItem(MenuTab *self, MenuItem *item)
+static byte *menuProcess_Intern(MenuProcess *self, const byte *str, size_t maxLen)
 {
-  assert(self && item);
-  assert(self->count < MENU_MAX_MENU_ITEMS);
-  memcpy(&self->items[self->count], item, sizeof(MenuItem));
+  assert(self && str);
+  size_t len = 0;
+  while (len < maxLen && str[len] != '\0')
+    len++;
+
+  // offset 0 is always the empty string
+  for (word n = 0; n < self->namesSize; n += (word)strlen(&self->names[n]) + 1)
+    if (strlen(&self->names[n]) == len && memcmp(&self->names[n], str, len) == 0)
+      return &self->names[n];
+
+  assert(self->namesSize + len + 1 <= MENU_NAMES_SIZE);
+  byte *interned = &self->names[self->namesSize];
+  memcpy(interned, str, len);
+  interned[len] = '\0';
+  self->namesSize += (word)(len + 1);
+  return interned;
+}
+
+static void menuProcess_Clear(MenuProcess *self)
+{
+  assert(self);
+  self->head = 0;
+  self->active = 0;
+  self->count = 0;
+  self->itemCount = 0;
+  self->names[0] = '\0';
+  self->namesSize = 1;
+  self->dirtyRows = MENU_ROWS_ALL;
+}
+
+static void menuProcess_Invalidate(MenuProcess *self)
+{
+  assert(self);
+  self->dirtyRows = MENU_ROWS_ALL;
+}
+
+static MenuTab *menuProcess_AddTab(MenuProcess *self, const byte *name)
+{
+  assert(self && name);
+  assert(self->count < MENU_MAX_TABS);
+  if (self->namesSize == 0)
+    menuProcess_Clear(self);
+
+  MenuTab *tab = &self->tabs[self->count];
   self->count++;
+  memset(tab, 0, sizeof(MenuTab));
+  tab->name = menuProcess_Intern(self, name, MENU_TAB_NAME_SIZE - 1);
+  tab->items = &self->items[self->itemCount];
+  return tab;
+}
+
+static MenuItem *menuProcess_AddItem(MenuProcess *self, MenuTab *tab, const byte *name, const byte *tag)
+{
+  assert(self && tab && name);
+  // items are only ever appended to the newest tab to keep its range whole
+  assert(tab == &self->tabs[self->count - 1]);
+  assert(tab->count < MENU_MAX_MENU_ITEMS);
+  assert(self->itemCount < MENU_MAX_POOL_ITEMS);
+
+  MenuItem *item = &self->items[self->itemCount];
+  self->itemCount++;
+  tab->count++;
+  memset(item, 0, sizeof(MenuItem));
+  item->name = menuProcess_Intern(self, name, MENU_ITEM_NAME_SIZE - 1);
+  item->tag = menuProcess_Intern(self, tag ? tag : (const byte *)"", MENU_ITEM_TAG_SIZE - 1);
+  return item;
+}
+
+static void menuTab_Select(MenuTab *self, System *sys)
+{
+  assert(self && sys);
+  if (self->active < self->count && self->items[self->active].select)
+  {
+    self->items[self->active].select(
+      &self->items[self->active],
+      sys
+    );
+  }
 }
 
-static void menuTab_HandleInput(MenuTab *self, System *sys)
+static byte menuTab_ItemRow(MenuTab *self, byte item)
+{
+  return (byte)(1 << (item - self->head + 1));
+}
+
+static byte menuTab_HandleInput(MenuTab *self, System *sys)
 {
   assert(self && sys);
+  byte previous = self->active;
+  byte previousHead = self->head;
+  byte dirtyRows = MENU_ROWS_NONE;
 
-  if (sys->mem.inpt.btns & INPT_BTN_DOWN)
+  for (byte n = _inptPresses(sys, INPT_BTN_DOWN); n > 0; n--)
   {
     self->active++;
     self->active = self->active >= self->count 
@@ -60,24 +157,34 @@ static void menuTab_HandleInput(MenuTab *self, System *sys)
     if (self->active < self->head)
       self->head = self->active;
 
-    if (self->active - self->head >= 7)
+    if (self->active - self->head >= MENU_VISIBLE_ITEMS)
       self->head++;
   }
 
-  if (sys->mem.inpt.btns & INPT_BTN_UP)
+  for (byte n = _inptPresses(sys, INPT_BTN_UP); n > 0; n--)
   {
     self->active--;
     self->active = (sbyte)self->active < 0
       ? self->count - 1
       : self->active;
 
-    while (self->active - self->head >= 7)
+    while (self->active - self->head >= MENU_VISIBLE_ITEMS)
       self->head++;
 
     if ((sbyte)self->active < (sbyte)self->head)
       self->head = self->active;
   }
 
+  if (self->active != previous)
+  {
+    menuTab_Select(self, sys);
+    // a scroll shifts every item row, otherwise only the highlight moved
+    if (self->head != previousHead)
+      dirtyRows = MENU_ROWS_ITEMS;
+    else
+      dirtyRows = menuTab_ItemRow(self, previous) | menuTab_ItemRow(self, self->active);
+  }
+
   if (sys->mem.inpt.btns & INPT_BTN_A)
   {
     if (self->items[self->active].execute)
@@ -88,35 +195,38 @@ static void menuTab_HandleInput(MenuTab *self, System *sys)
       );
     }
   }
+  return dirtyRows;
 }
 
-static void menuTab_Draw(MenuTab *self, System *sys)
+static void menuTab_Draw(MenuTab *self, System *sys, byte dirtyRows)
 {
-  for (int m = 0, i = self->head; i < self->count; m++, i++) 
+  for (int m = 0, i = self->head; i < self->count && m < MENU_VISIBLE_ITEMS; m++, i++) 
   {
+    if (!(dirtyRows & (1 << (m + 1))))
+      continue;
+
     char name[17] = {'\0'};
     sprintf(name, "%d:", (i + 1) < 10 ? (i + 1) : 0);
     _output(sys, m+1, 0, name, 
       i == self->active ? DISP_FLAG_INVERT : DISP_FLAG_NONE);
     
-    strncpy(name, self->items[i].name, sizeof(name) - 3);
+    // a tag is right aligned and clips the end of the name
+    byte tagLen = (byte)strlen(self->items[i].tag);
+    byte nameLen = tagLen > 0 ? DISP_CHAR_CELL_COLS - 3 - tagLen : sizeof(name) - 3;
+    memset(name, 0, sizeof(name));
+    strncpy(name, self->items[i].name, min(nameLen, sizeof(name) - 3));
     _output(sys, m+1, 2, name, DISP_FLAG_NONE);
+    if (tagLen > 0)
+      _output(sys, m+1, DISP_CHAR_CELL_COLS - tagLen, self->items[i].tag, DISP_FLAG_NONE);
   }
 }
 
-static void menuProcess_AddTab(MenuProcess *self, MenuTab *tab)
-{
-  assert(self && tab);
-  assert(self->count < MENU_MAX_TABS);
-  memcpy(&self->tabs[self->count], tab, sizeof(MenuTab));
-  self->count++;
-}
-
 static void menuProcess_HandleInput(MenuProcess *self, System *sys)
 {
   assert(self && sys);
+  byte previous = self->active;
 
-  if (sys->mem.inpt.btns & INPT_BTN_RIGHT)
+  for (byte n = _inptPresses(sys, INPT_BTN_RIGHT); n > 0; n--)
   {
     self->active++;
     self->active = self->active >= self->count 
@@ -126,7 +236,7 @@ static void menuProcess_HandleInput(MenuProcess *self, System *sys)
       self->head++;
   }
 
-  if (sys->mem.inpt.btns & INPT_BTN_LEFT)
+  for (byte n = _inptPresses(sys, INPT_BTN_LEFT); n > 0; n--)
   {
     self->active--;
     self->active = (sbyte)self->active < 0
@@ -136,40 +246,96 @@ static void menuProcess_HandleInput(MenuProcess *self, System *sys)
       self->head--;
   }
 
-  menuTab_HandleInput(&self->tabs[self->active], sys);
+  if (self->active != previous)
+  {
+    menuTab_Select(&self->tabs[self->active], sys);
+    self->dirtyRows = MENU_ROWS_ALL;
+  }
+
+  self->dirtyRows |= menuTab_HandleInput(&self->tabs[self->active], sys);
 }
 
+// only the rows flagged since the last draw are cleared and redrawn, an
+// idle menu leaves the char cells alone
 static void menuProcess_Draw(MenuProcess *self, System *sys)
 {
-  _clrHome(sys);
+  if (self->dirtyRows == MENU_ROWS_NONE)
+    return;
+
+  if (self->dirtyRows == MENU_ROWS_ALL)
+  {
+    _clrHome(sys);
+  }
+  else
+  {
+    for (byte r = 0; r < DISP_CHAR_CELL_ROWS; r++)
+      if (self->dirtyRows & (1 << r))
+        _clrRow(sys, r);
+  }
 
-  if (self->count > 1) 
+  if (self->dirtyRows & 0x01)
   {
-    for (byte c = self->head, i = 0; c < self->count; c++, i++) 
+    if (self->count > 1) 
     {
-      bool isActiveTab = c == self->active;
-      MenuTab *tab = (MenuTab *)&self->tabs[c];
-      char tabNameBuffer[5] = {'\0'};
-      strncpy(tabNameBuffer, tab->name, sizeof(tabNameBuffer) - 1);
-      _output(sys, 0, (i * 5) + (self->head > 0 ? 1 : 0), 
-        tabNameBuffer, isActiveTab ? DISP_FLAG_INVERT : DISP_FLAG_NONE);
-      if (isActiveTab)
-        menuTab_Draw(tab, sys);
-    }
+      for (byte c = self->head, i = 0; c < self->count; c++, i++) 
+      {
+        bool isActiveTab = c == self->active;
+        MenuTab *tab = (MenuTab *)&self->tabs[c];
+        char tabNameBuffer[5] = {'\0'};
+        strncpy(tabNameBuffer, tab->name, sizeof(tabNameBuffer) - 1);
+        _output(sys, 0, (i * 5) + (self->head > 0 ? 1 : 0), 
+          tabNameBuffer, isActiveTab ? DISP_FLAG_INVERT : DISP_FLAG_NONE);
+      }
 
-    if (self->count - self->head > 3) {
-      _outputc(sys, 0, DISP_CHAR_CELL_COLS - 1, 240, DISP_FLAG_NONE);
-    }
+      if (self->count - self->head > 3) {
+        _outputc(sys, 0, DISP_CHAR_CELL_COLS - 1, 240, DISP_FLAG_NONE);
+      }
 
-    if (self->head > 0) {
-      _outputc(sys, 0, 0, 240, DISP_FLAG_NONE);
+      if (self->head > 0) {
+        _outputc(sys, 0, 0, 240, DISP_FLAG_NONE);
+      }
     }
+    else 
+    {
+      _output(sys, 0, 0, self->tabs[0].name, DISP_FLAG_INVERT);
+    }
+  }
+
+  if (self->count > 0)
+    menuTab_Draw(&self->tabs[self->active], sys, self->dirtyRows);
+  self->dirtyRows = MENU_ROWS_NONE;
+}
+
+static void menuProcess_SaveState(MenuProcess *self, byte *state)
+{
+  assert(self && state);
+  assert(3 + self->count * 2 <= PROC_STATE_SIZE);
+  state[0] = self->head;
+  state[1] = self->active;
+  state[2] = self->count;
+  for (byte t = 0; t < self->count; t++)
+  {
+    state[3 + t * 2] = self->tabs[t].head;
+    state[4 + t * 2] = self->tabs[t].active;
   }
-  else 
+}
+
+static void menuProcess_LoadState(MenuProcess *self, const byte *state)
+{
+  assert(self && state);
+  // the menu may have been rebuilt with fewer tabs or items since the save
+  if (state[2] != self->count || state[1] >= self->count)
+    return;
+  self->head = state[0];
+  self->active = state[1];
+  for (byte t = 0; t < self->count; t++)
   {
-    _output(sys, 0, 0, self->tabs[0].name, DISP_FLAG_INVERT);
-    menuTab_Draw(&self->tabs[0], sys);
+    if (state[4 + t * 2] >= self->tabs[t].count || state[3 + t * 2] > state[4 + t * 2])
+      continue;
+    self->tabs[t].head = state[3 + t * 2];
+    self->tabs[t].active = state[4 + t * 2];
   }
+  menuProcess_Invalidate(self);
 }
 
 static void menuProcess_Tick(MenuProcess *self, System *sys)
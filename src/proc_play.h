@@ -0,0 +1,400 @@
+#ifndef FC85_PROC_IMPLEMENTATIONS
+#ifndef _proc_play_h_
+#define _proc_play_h_
+/* ------------------------------------------------------------------------- */
+
+#include "lang.h"
+
+#define PLAY_INSTRUCTION_BUDGET 20000 // Lua instructions per frame
+#define PLAY_STATUS_RUNNING     0
+#define PLAY_STATUS_DONE        1
+#define PLAY_STATUS_ERROR       2
+#define PLAY_CACHE_MAGIC        0x43424346 // FCBC
+#ifndef PLAY_HEAP_SIZE
+#define PLAY_HEAP_SIZE          (1024 * 1024) // per game, override with /D
+#endif
+#define PLAY_HEAP_GRAIN         16
+#define PLAY_HEAP_SMALL_MAX     512
+#define PLAY_HEAP_SMALL_CLASSES (PLAY_HEAP_SMALL_MAX / PLAY_HEAP_GRAIN)
+#define PLAY_HEAP_CLASSES       (PLAY_HEAP_SMALL_CLASSES + 24)
+
+// compiled games are kept on disk as ~name, a header followed by the
+// lua_dump of the chunk, and only used while the hash of the source and
+// the transpiler version still matches. The hash only tells stale entries
+// apart, the disk device refuses cache files this install did not write.
+typedef struct {
+  dword magic;
+  dword hash;
+  dword size;
+  byte name[DISK_FILE_NAME_SIZE];
+} PlayCacheHeader;
+
+// a game's Lua heap is one fixed block: small sizes get a class per grain,
+// larger ones a class per power of two, each with its own free list, and
+// fresh blocks are cut from the top. Lua passes the old size on every free
+// and resize, so blocks carry no header. Nothing is ever coalesced, the
+// whole heap goes at once when the game ends.
+typedef struct {
+  byte *base;
+  size_t top;
+  size_t used;
+  size_t peak;
+  dword failures;
+  void *free[PLAY_HEAP_CLASSES];
+} PlayHeap;
+
+// the game runs as a coroutine that a count hook yields out of once it has
+// used up the frame's instruction budget, so it runs as many statements as
+// fit in a frame and never blocks the console
+typedef struct {
+  lua_State *lua;
+  lua_State *thread;
+  byte status;
+  PlayHeap heap;
+#ifdef FC85_PROFILE
+  struct _profiler *prof;
+#endif
+} PlayProcess;
+
+static void playProcess_Execute(System *sys);
+
+/* ------------------------------------------------------------------------- */
+#endif
+#endif
+#ifdef FC85_PROC_IMPLEMENTATIONS
+#ifndef _proc_play_c_
+#define _proc_play_c_
+/* ------------------------------------------------------------------------- */
+
+static byte playHeap_Class(size_t size, size_t *rounded)
+{
+  if (size <= PLAY_HEAP_SMALL_MAX)
+  {
+    size_t grains = (size + PLAY_HEAP_GRAIN - 1) / PLAY_HEAP_GRAIN;
+    *rounded = grains * PLAY_HEAP_GRAIN;
+    return (byte)(grains - 1);
+  }
+
+  byte cls = PLAY_HEAP_SMALL_CLASSES;
+  size_t classSize = PLAY_HEAP_SMALL_MAX * 2;
+  while (classSize < size)
+  {
+    classSize *= 2;
+    cls++;
+  }
+  assert(cls < PLAY_HEAP_CLASSES);
+  *rounded = classSize;
+  return cls;
+}
+
+static void *playHeap_Take(PlayHeap *self, size_t size)
+{
+  size_t rounded;
+  byte cls = playHeap_Class(size, &rounded);
+  void *block = self->free[cls];
+  if (block)
+  {
+    self->free[cls] = *(void **)block;
+  }
+  else if (self->top + rounded <= PLAY_HEAP_SIZE)
+  {
+    block = self->base + self->top;
+    self->top += rounded;
+  }
+  else
+  {
+    self->failures++;
+    return NULL;
+  }
+
+  self->used += rounded;
+  self->peak = max(self->peak, self->used);
+  return block;
+}
+
+static void playHeap_Give(PlayHeap *self, void *block, size_t size)
+{
+  size_t rounded;
+  byte cls = playHeap_Class(size, &rounded);
+  *(void **)block = self->free[cls];
+  self->free[cls] = block;
+  self->used -= rounded;
+}
+
+// lua_Alloc, a failed allocation is a Lua memory error the game dies of
+static void *playHeap_Alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+  PlayHeap *self = (PlayHeap *)ud;
+  if (nsize == 0)
+  {
+    if (ptr)
+      playHeap_Give(self, ptr, osize);
+    return NULL;
+  }
+
+  // without a block osize only says what kind of object is coming
+  if (ptr == NULL)
+    return playHeap_Take(self, nsize);
+
+  size_t oldRounded, newRounded;
+  if (playHeap_Class(osize, &oldRounded) == playHeap_Class(nsize, &newRounded))
+    return ptr;
+
+  void *block = playHeap_Take(self, nsize);
+  if (!block)
+  {
+    // Lua counts on shrinking never failing, so the old block is kept and
+    // from now on freed as its new class, its tail is given up
+    if (nsize > osize)
+      return NULL;
+    self->used -= oldRounded - newRounded;
+    return ptr;
+  }
+  memcpy(block, ptr, min(osize, nsize));
+  playHeap_Give(self, ptr, osize);
+  return block;
+}
+
+static int playProcess_Disp(lua_State *L)
+{
+  System *sys = (System *)lua_touserdata(L, lua_upvalueindex(1));
+  int argc = lua_gettop(L);
+  for (int i = 1; i <= argc; i++)
+    _disp(sys, (byte *)luaL_checkstring(L, i), true);
+  return 0;
+}
+
+static int playProcess_Error(lua_State *L)
+{
+  return luaL_error(L, "%s", luaL_checkstring(L, 1));
+}
+
+static void playProcess_Hook(lua_State *L, lua_Debug *ar)
+{
+  lua_yield(L, 0);
+}
+
+static void playProcess_Fail(PlayProcess *self, System *sys, const char *error)
+{
+  printf("[FC-85] game error: %s\n", error ? error : "unknown");
+  _disp(sys, "ERROR!", true);
+  self->status = PLAY_STATUS_ERROR;
+}
+
+static dword playProcess_Hash(const char *code, size_t length)
+{
+  dword hash = (2166136261u ^ LANG_VERSION) * 16777619u;
+  for (size_t c = 0; c < length; c++)
+  {
+    hash ^= (byte)code[c];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// ~, the start of the game's name and a hash of all of it, which fits a
+// file name whatever the length of the game's
+static void playProcess_CacheName(const Game *game, byte *name)
+{
+  const char *gameName = (const char *)game->content.name;
+  const char *nameEnd = (const char *)memchr(gameName, '\0', sizeof(game->content.name));
+  size_t nameLength = nameEnd ? (size_t)(nameEnd - gameName) : sizeof(game->content.name);
+  memset(name, 0, DISK_FILE_NAME_SIZE);
+  snprintf((char *)name, DISK_FILE_NAME_SIZE, "%c%.8s%06x", DISK_CACHE_PREFIX, gameName,
+    playProcess_Hash(gameName, nameLength) & 0xffffff);
+}
+
+// pushes the cached chunk when there is one for this exact source
+static bool playProcess_LoadCache(PlayProcess *self, System *sys, const Game *game, dword hash)
+{
+  playProcess_CacheName(game, sys->mem.disk.name);
+  sys->mem.disk.code = DISK_CODE_READ;
+  _interrupt(sys, INTERRUPT_CODE_DISK);
+
+  const PlayCacheHeader *hdr = (const PlayCacheHeader *)sys->mem.disk.buffer;
+  if (hdr->magic != PLAY_CACHE_MAGIC || hdr->hash != hash ||
+    hdr->size > sizeof(sys->mem.disk.buffer) - sizeof(PlayCacheHeader) ||
+    strncmp(hdr->name, game->content.name, sizeof(hdr->name)) != 0)
+    return false;
+
+  // bytecode from another Lua build fails its header check and is rebuilt
+  if (luaL_loadbufferx(self->lua, (const char *)(hdr + 1), hdr->size,
+    game->content.name, "b") != LUA_OK)
+  {
+    lua_pop(self->lua, 1);
+    return false;
+  }
+  return true;
+}
+
+static int playProcess_DumpWriter(lua_State *L, const void *p, size_t size, void *data)
+{
+  langBuilder_Append((LangBuilder *)data, (const char *)p, size);
+  return 0;
+}
+
+// stores the chunk on top of the stack, a chunk too big for a file is
+// simply compiled again next time. Debug info is kept, so errors name the
+// same lines whether or not the game came from the cache.
+static void playProcess_StoreCache(PlayProcess *self, System *sys, const Game *game, dword hash)
+{
+  LangBuilder bytecode;
+  langBuilder_Init(&bytecode);
+  if (lua_dump(self->lua, playProcess_DumpWriter, &bytecode, 0) == 0 &&
+    sizeof(PlayCacheHeader) + bytecode.length + DISK_CACHE_TAG_SIZE <= sizeof(sys->mem.disk.buffer))
+  {
+    PlayCacheHeader *hdr = (PlayCacheHeader *)sys->mem.disk.buffer;
+    memset(hdr, 0, sizeof(PlayCacheHeader));
+    hdr->magic = PLAY_CACHE_MAGIC;
+    hdr->hash = hash;
+    hdr->size = (dword)bytecode.length;
+    strncpy(hdr->name, game->content.name, sizeof(hdr->name) - 1);
+    memcpy(hdr + 1, bytecode.data, bytecode.length);
+    playProcess_CacheName(game, sys->mem.disk.name);
+    sys->mem.disk.size = (dword)(sizeof(PlayCacheHeader) + bytecode.length);
+    sys->mem.disk.code = DISK_CODE_WRITE;
+    _interrupt(sys, INTERRUPT_CODE_DISK);
+  }
+  langBuilder_Dispose(&bytecode);
+}
+
+// what the game can call, registered in a protected call so a heap too
+// small for it fails the game instead of panicking
+static int playProcess_Setup(lua_State *L)
+{
+  lua_pushvalue(L, 1);
+  lua_pushcclosure(L, playProcess_Disp, 1);
+  lua_setglobal(L, "Disp");
+  lua_register(L, LANG_ERROR_FUNC_NAME, playProcess_Error);
+  return 0;
+}
+
+// runs the chunk passed in and returns the thread the game plays on with
+// fc85run waiting on it, the thread is kept in the registry so it is never
+// collected
+static int playProcess_Start(lua_State *L)
+{
+  lua_call(L, 0, 0);
+  lua_State *thread = lua_newthread(L);
+  lua_pushvalue(L, -1);
+  luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_getglobal(L, LANG_RUN_FUNC_NAME);
+  lua_xmove(L, thread, 1);
+  return 1;
+}
+
+static PlayProcess *playProcess_Create(System *sys)
+{
+  PlayProcess *self = (PlayProcess *)processArena_Alloc(sys->procArena, PROC_TYPE_PLAY);
+  Game *game = (Game *)sys->mem.appl;
+#ifdef FC85_PROFILE
+  Uint64 start = SDL_GetPerformanceCounter();
+#endif
+  _clrHome(sys);
+
+  // the code may fill its buffer without a terminator
+  const char *code = (const char *)game->code;
+  const char *codeEnd = (const char *)memchr(code, '\0', sizeof(game->code));
+  size_t codeLength = codeEnd ? (size_t)(codeEnd - code) : sizeof(game->code);
+  dword hash = playProcess_Hash(code, codeLength);
+
+#ifdef FC85_PROFILE
+  self->prof = sys->prof;
+#endif
+  self->heap.base = (byte *)malloc(PLAY_HEAP_SIZE);
+  assert(self->heap.base);
+  self->lua = lua_newstate(playHeap_Alloc, &self->heap);
+  if (!self->lua)
+  {
+    playProcess_Fail(self, sys, "not enough memory");
+    return self;
+  }
+  lua_pushcfunction(self->lua, playProcess_Setup);
+  lua_pushlightuserdata(self->lua, sys);
+  if (lua_pcall(self->lua, 1, 0, 0) != LUA_OK)
+  {
+    playProcess_Fail(self, sys, lua_tostring(self->lua, -1));
+    return self;
+  }
+
+  bool cached = playProcess_LoadCache(self, sys, game, hash);
+  if (!cached)
+  {
+    size_t tcodeLength = 0;
+    const char *error = NULL;
+    char *tcode = lang_Transpile(code, codeLength, &tcodeLength, &error);
+    if (!tcode)
+    {
+      playProcess_Fail(self, sys, error);
+      return self;
+    }
+    int loaded = luaL_loadbufferx(self->lua, tcode, tcodeLength, game->content.name, "t");
+    free(tcode);
+    if (loaded != LUA_OK)
+    {
+      playProcess_Fail(self, sys, lua_tostring(self->lua, -1));
+      return self;
+    }
+    playProcess_StoreCache(self, sys, game, hash);
+  }
+#ifdef FC85_PROFILE
+  histogram_Add(cached ? &sys->prof->cached : &sys->prof->compiled,
+    (dword)((SDL_GetPerformanceCounter() - start) * 1000000 / sys->prof->frequency));
+#endif
+
+  lua_pushcfunction(self->lua, playProcess_Start);
+  lua_insert(self->lua, -2);
+  if (lua_pcall(self->lua, 1, 1, 0) != LUA_OK)
+  {
+    playProcess_Fail(self, sys, lua_tostring(self->lua, -1));
+    return self;
+  }
+  self->thread = lua_tothread(self->lua, -1);
+  lua_pop(self->lua, 1);
+  lua_sethook(self->thread, playProcess_Hook, LUA_MASKCOUNT, PLAY_INSTRUCTION_BUDGET);
+  return self;
+}
+
+// everything the game allocated is in its heap and games cannot set
+// finalizers, so the heap is dropped without closing the state
+static void playProcess_Destroy(PlayProcess *self)
+{
+  assert(self);
+#ifdef FC85_PROFILE
+  self->prof->heapPeak = max(self->prof->heapPeak, self->heap.peak);
+  self->prof->heapFailures += self->heap.failures;
+#endif
+  free(self->heap.base);
+  memset(self, 0, sizeof(PlayProcess));
+}
+
+static void playProcess_Tick(PlayProcess *self, System *sys)
+{
+  if (self->status != PLAY_STATUS_RUNNING)
+    return;
+
+  int ret = lua_resume(self->thread, self->lua, 0);
+  if (ret == LUA_YIELD)
+    return;
+
+  if (ret == LUA_OK)
+  {
+    _disp(sys, "Done", true);
+    self->status = PLAY_STATUS_DONE;
+  }
+  else
+  {
+    playProcess_Fail(self, sys, lua_tostring(self->thread, -1));
+  }
+}
+
+// plays the game loaded in appl memory, ESC leaves it
+static void playProcess_Execute(System *sys)
+{
+  PlayProcess *proc = playProcess_Create(sys);
+  system_PushProc(sys, PROC_TYPE_PLAY, proc, playProcess_Tick, NULL, playProcess_Destroy);
+}
+
+/* ------------------------------------------------------------------------- */
+#endif
+#endif
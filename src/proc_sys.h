@@ -10,6 +10,8 @@ typedef struct {
 } SysProcess;
 
 static void sysProcess_Execute(System *sys);
+static void sysProcess_Save(SysProcess *self, System *sys, byte *state);
+static void sysProcess_Resume(System *sys, const byte *state);
 
 /* ------------------------------------------------------------------------- */
 #endif
@@ -29,28 +31,19 @@ static void sysProcess_menuItem_ShutdownExecute(MenuItem *self, System *sys)
   system_SetShutdownFlag(sys);
 }
 
-static SysProcess *sysProcess_Create()
+static SysProcess *sysProcess_Create(System *sys)
 {
-  SysProcess *self = (SysProcess *)calloc(1, sizeof(SysProcess));
-  assert(self);
-
-  MenuTab tab;
-  MenuItem item;
+  SysProcess *self = (SysProcess *)processArena_Alloc(sys->procArena, PROC_TYPE_SYS);
 
-  memset(&tab, 0, sizeof(tab));
-  strncpy(tab.name, "FC-85:SYS", sizeof(tab.name) - 1);
+  MenuTab *tab = menuProcess_AddTab(&self->base, "FC-85:SYS");
+  MenuItem *item;
 
-  memset(&item, 0, sizeof(item));
-  strncpy(item.name, "Games", sizeof(item.name) - 1);
-  item.execute = sysProcess_menuItem_GamesExecute;
-  menuTab_AddItem(&tab, &item);
+  item = menuProcess_AddItem(&self->base, tab, "Games", NULL);
+  item->execute = sysProcess_menuItem_GamesExecute;
 
-  memset(&item, 0, sizeof(item));
-  strncpy(item.name, "Shutdown", sizeof(item.name) - 1);
-  item.execute = sysProcess_menuItem_ShutdownExecute;
-  menuTab_AddItem(&tab, &item);
+  item = menuProcess_AddItem(&self->base, tab, "Shutdown", NULL);
+  item->execute = sysProcess_menuItem_ShutdownExecute;
 
-  menuProcess_AddTab(&self->base, &tab);
   return self;
 }
 
@@ -58,7 +51,11 @@ static void sysProcess_Destroy(SysProcess *self)
 {
   assert(self);
   memset(self, 0, sizeof(SysProcess));
-  free(self);
+}
+
+static void sysProcess_Restore(SysProcess *self, System *sys)
+{
+  menuProcess_Invalidate(&self->base);
 }
 
 static void sysProcess_Tick(SysProcess *self, System *sys)
@@ -68,8 +65,20 @@ static void sysProcess_Tick(SysProcess *self, System *sys)
 
 static void sysProcess_Execute(System *sys)
 {
-  SysProcess *sysProc = sysProcess_Create();
-  system_PushProc(sys, sysProc, sysProcess_Tick, NULL, sysProcess_Destroy);
+  SysProcess *sysProc = sysProcess_Create(sys);
+  system_PushProc(sys, PROC_TYPE_SYS, sysProc, sysProcess_Tick, sysProcess_Restore, sysProcess_Destroy);
+}
+
+static void sysProcess_Save(SysProcess *self, System *sys, byte *state)
+{
+  menuProcess_SaveState(&self->base, state);
+}
+
+static void sysProcess_Resume(System *sys, const byte *state)
+{
+  sysProcess_Execute(sys);
+  SysProcess *self = (SysProcess *)sys->procStack[sys->procCount - 1].data;
+  menuProcess_LoadState(&self->base, state);
 }
 
 /* ------------------------------------------------------------------------- */